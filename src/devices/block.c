@@ -19,6 +19,8 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long seek_cnt;        /* Sectors the head moved over. */
+    block_sector_t head;                /* Sector after the last accessed. */
   };
 
 /* List of all block devices. */
@@ -28,6 +30,7 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void count_seek (struct block *, block_sector_t);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -123,6 +126,7 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
   check_sector (block, sector);
   block->ops->read (block->aux, sector, buffer);
   block->read_cnt++;
+  count_seek (block, sector);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -137,6 +141,7 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   ASSERT (block->type != BLOCK_FOREIGN);
   block->ops->write (block->aux, sector, buffer);
   block->write_cnt++;
+  count_seek (block, sector);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -171,9 +176,10 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          printf ("%s (%s): %llu reads, %llu writes, "
+                  "%llu sectors of seeks\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->read_cnt, block->write_cnt, block->seek_cnt);
         }
     }
 }
@@ -200,6 +206,8 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->seek_cnt = 0;
+  block->head = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -221,3 +229,15 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+
+/* Adds the distance from the sector after the last one accessed
+   on BLOCK to SECTOR, which is being accessed, to BLOCK's seek
+   count.  Sequential accesses count nothing. */
+static void
+count_seek (struct block *block, block_sector_t sector)
+{
+  block->seek_cnt += (sector > block->head
+                      ? sector - block->head
+                      : block->head - sector);
+  block->head = sector + 1;
+}
@@ -5,13 +5,21 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/swap.h"
+#include "vm/writeback.h"
 #endif
 
 /* Keyboard control register port. */
@@ -21,6 +29,7 @@
 static enum shutdown_type how = SHUTDOWN_NONE;
 
 static void print_stats (void);
+static void power_off (void) NO_RETURN;
 
 /* Shuts down the machine in the way configured by
    shutdown_configure().  If the shutdown type is SHUTDOWN_NONE
@@ -87,12 +96,27 @@ shutdown_reboot (void)
 void
 shutdown_power_off (void)
 {
-  const char s[] = "Shutdown";
-  const char *p;
-
 #ifdef FILESYS
   filesys_done ();
 #endif
+  power_off ();
+}
+
+/* Powers down the machine without writing the file system's
+   unwritten data to disk, as a power failure would, for testing
+   recovery. */
+void
+shutdown_crash (void)
+{
+  power_off ();
+}
+
+/* Prints statistics and powers down the machine. */
+static void
+power_off (void)
+{
+  const char s[] = "Shutdown";
+  const char *p;
 
   print_stats ();
 
@@ -130,12 +154,20 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  slab_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  cache_print_stats ();
+  dcache_print_stats ();
+  journal_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  swap_print_stats ();
+  writeback_print_stats ();
+#endif
 }
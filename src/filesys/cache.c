@@ -0,0 +1,363 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache of file system sectors.
+
+   All file system I/O goes through a fixed set of cached sectors,
+   replaced with the clock algorithm.  Writes only modify the
+   cached copy, which is written to disk when the sector is
+   evicted, every cache_flush_secs seconds, and when the file
+   system is shut down.  Reads of a file also queue the sector
+   that follows for reading in the background.
+
+   Metadata is written with cache_write_meta() instead, and stays
+   out of all that until the journal commits it.  Evicting such a
+   sector leaves its contents with the journal.
+
+   Disk I/O is done without holding cache_lock.  An entry whose
+   sector is being read or written is marked busy, and everyone
+   else waits on io_done until it is not. */
+
+/* Number of cached sectors. */
+#define CACHE_SIZE 64
+
+/* Most sectors waiting to be read ahead. */
+#define READ_AHEAD_MAX 8
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector held, if valid or busy. */
+    bool valid;                         /* True if data holds sector. */
+    bool dirty;                         /* True if data differs from disk. */
+    bool accessed;                      /* Used since the clock last passed. */
+    bool busy;                          /* Being read or written. */
+    bool meta;                          /* In the running transaction. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Protects the cache and the read-ahead queue. */
+static struct lock cache_lock;
+
+/* Signaled when an entry stops being busy. */
+static struct condition io_done;
+
+/* Next entry considered by the clock. */
+static size_t clock_hand;
+
+/* Sectors to read ahead, a ring buffer of ra_cnt sectors starting
+   at ra_head, and the condition signaled when one is queued. */
+static block_sector_t ra_queue[READ_AHEAD_MAX];
+static size_t ra_head, ra_cnt;
+static struct condition ra_queued;
+
+/* Statistics. */
+static unsigned long long hit_cnt, miss_cnt, read_ahead_cnt;
+
+/* -flush=SECS: Seconds between two writes of all dirty sectors.
+   Tests that crash on purpose set it high, so that only their own
+   fsync() calls reach the journal. */
+int cache_flush_secs = 5;
+
+static struct cache_entry *get_entry (block_sector_t, bool fill);
+static struct cache_entry *find_entry (block_sector_t);
+static void write_entry (struct cache_entry *);
+static thread_func read_ahead_thread;
+static thread_func flush_thread;
+
+/* Initializes the buffer cache and starts the threads that read
+   ahead and flush it. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&io_done);
+  cond_init (&ra_queued);
+  for (i = 0; i < CACHE_SIZE; i++)
+    cache[i].valid = cache[i].busy = cache[i].meta = false;
+
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+  thread_create ("cache-flush", PRI_DEFAULT, flush_thread, NULL);
+}
+
+/* Copies SIZE bytes starting at byte OFS of SECTOR into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte
+   OFS.  The sector is written to disk later. */
+void
+cache_write (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  /* A sector that is overwritten whole need not be read first. */
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  lock_release (&cache_lock);
+}
+
+/* Like cache_write(), for a sector of metadata, which joins the
+   journal's running transaction.  Must be called between
+   journal_begin() and journal_end(). */
+void
+cache_write_meta (block_sector_t sector, const void *buffer, int ofs,
+                  int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  if (!e->meta)
+    {
+      e->meta = true;
+      journal_add (sector);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes SECTOR, a sector of the transaction being committed, in
+   place. */
+void
+cache_write_back (block_sector_t sector)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, true);
+  journal_forget (sector);
+  e->meta = false;
+  if (e->dirty)
+    write_entry (e);
+  lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR to be read into the cache in the background,
+   unless it already is or too many sectors are queued. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  if (ra_cnt < READ_AHEAD_MAX && find_entry (sector) == NULL)
+    {
+      ra_queue[(ra_head + ra_cnt++) % READ_AHEAD_MAX] = sector;
+      cond_signal (&ra_queued, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector to disk, except for those of the
+   journal's running transaction. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      while (e->busy)
+        cond_wait (&io_done, &cache_lock);
+      if (e->valid && e->dirty && !e->meta)
+        write_entry (e);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %llu hits, %llu misses, %llu sectors read ahead\n",
+          hit_cnt, miss_cnt, read_ahead_cnt);
+}
+
+/* Returns the entry holding SECTOR, loading it into an entry
+   chosen by the clock if it is not cached.  The sector is read
+   from disk only if FILL is true; otherwise the caller is about
+   to overwrite all of it.  Must be called with cache_lock held,
+   which may be released and reacquired meanwhile. */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool fill)
+{
+  for (;;)
+    {
+      struct cache_entry *e = find_entry (sector);
+      struct cache_entry *meta_victim = NULL;
+      size_t i;
+
+      if (e != NULL)
+        {
+          if (e->busy)
+            {
+              cond_wait (&io_done, &cache_lock);
+              continue;
+            }
+          e->accessed = true;
+          hit_cnt++;
+          return e;
+        }
+
+      /* Two sweeps of the clock find an unaccessed entry, unless
+         every entry is busy.  Entries of the running transaction
+         are taken only if there is nothing else. */
+      for (i = 0; i < 2 * CACHE_SIZE; i++)
+        {
+          struct cache_entry *c = &cache[clock_hand];
+          clock_hand = (clock_hand + 1) % CACHE_SIZE;
+          if (c->busy)
+            continue;
+          if (!c->valid || !c->accessed)
+            {
+              if (!c->valid || !c->meta)
+                {
+                  e = c;
+                  break;
+                }
+              if (meta_victim == NULL)
+                meta_victim = c;
+            }
+          c->accessed = false;
+        }
+      if (e == NULL)
+        e = meta_victim;
+      if (e == NULL)
+        {
+          cond_wait (&io_done, &cache_lock);
+          continue;
+        }
+      if (e->valid && e->meta)
+        {
+          journal_save (e->sector, e->data);
+          e->meta = e->dirty = false;
+        }
+
+      /* Write back the victim, then look again, since SECTOR may
+         have been loaded while the lock was released. */
+      if (e->valid && e->dirty)
+        {
+          write_entry (e);
+          continue;
+        }
+
+      e->sector = sector;
+      e->valid = false;
+      e->dirty = false;
+      e->accessed = true;
+      e->meta = false;
+      miss_cnt++;
+      if (journal_load (sector, e->data))
+        e->meta = e->dirty = true;
+      else if (fill)
+        {
+          e->busy = true;
+          lock_release (&cache_lock);
+          block_read (fs_device, sector, e->data);
+          lock_acquire (&cache_lock);
+          e->busy = false;
+          cond_broadcast (&io_done, &cache_lock);
+        }
+      e->valid = true;
+      return e;
+    }
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if it is
+   not cached.  Must be called with cache_lock held. */
+static struct cache_entry *
+find_entry (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if ((cache[i].valid || cache[i].busy) && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Writes dirty entry E to disk.  Must be called with cache_lock
+   held, which is released during the write. */
+static void
+write_entry (struct cache_entry *e)
+{
+  ASSERT (e->valid && e->dirty && !e->busy);
+
+  e->busy = true;
+  e->dirty = false;
+  lock_release (&cache_lock);
+  block_write (fs_device, e->sector, e->data);
+  lock_acquire (&cache_lock);
+  e->busy = false;
+  cond_broadcast (&io_done, &cache_lock);
+}
+
+/* Reads queued sectors into the cache, forever. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      block_sector_t sector;
+
+      while (ra_cnt == 0)
+        cond_wait (&ra_queued, &cache_lock);
+      sector = ra_queue[ra_head];
+      ra_head = (ra_head + 1) % READ_AHEAD_MAX;
+      ra_cnt--;
+
+      if (find_entry (sector) == NULL)
+        {
+          get_entry (sector, true);
+          read_ahead_cnt++;
+          miss_cnt--;             /* Counted above, but nobody missed. */
+        }
+    }
+}
+
+/* Allocates sectors for delayed file data, commits the journal's
+   running transaction and writes dirty sectors to disk every
+   cache_flush_secs seconds, forever. */
+static void
+flush_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep ((int64_t) cache_flush_secs * TIMER_FREQ);
+      inode_flush_all ();
+      journal_commit ();
+      cache_flush ();
+    }
+}
@@ -1,38 +1,283 @@
 #include "filesys/directory.h"
+#include <hash.h>
+#include <round.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
+/* A directory is a file of sector-sized blocks that index its
+   entries by a hash of their names, in the manner of ext3's
+   htree.  Block 0 is the root of the index.  Its entries map
+   ranges of hashes to leaf blocks, which hold the directory
+   entries, or, once the directory outgrows the root, to index
+   blocks that map them to leaf blocks in turn.  Looking up a
+   name therefore reads at most three blocks, however many
+   entries the directory has.
+
+   All entries with the same hash share a leaf.  A full leaf,
+   along with any overflow leaves chained to it, is split at the
+   median of its hashes.  Only if its entries all have the same
+   hash is another overflow leaf chained to it instead.  Leaves
+   are never merged. */
+
+/* Identifies the root block of a directory. */
+#define DIR_MAGIC 0x44495248
+
+/* Types of the blocks after the root. */
+#define INDEX_BLOCK 1
+#define LEAF_BLOCK 2
+
+/* Number of index entries in the root and in an index block, and
+   of directory entries in a leaf. */
+#define ROOT_INDEX_CNT 61
+#define INDEX_CNT 63
+#define LEAF_CNT 25
+
 /* A directory. */
-struct dir 
+struct dir
   {
     struct inode *inode;                /* Backing store. */
     off_t pos;                          /* Current position. */
   };
 
 /* A single directory entry. */
-struct dir_entry 
+struct dir_entry
   {
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* Maps the hashes from HASH up to those of the next index entry
+   to a block. */
+struct index_entry
+  {
+    uint32_t hash;                      /* First hash of the range. */
+    uint32_t block;                     /* Block within the directory. */
+  };
+
+/* Block 0 of a directory. */
+struct dir_root
+  {
+    uint32_t magic;                     /* DIR_MAGIC. */
+    uint32_t depth;                     /* 0 if INDEX maps to leaves,
+                                           1 if to index blocks. */
+    uint32_t cnt;                       /* Entries of INDEX in use. */
+    uint32_t entry_cnt;                 /* Directory entries in use. */
+    uint32_t block_cnt;                 /* Blocks in the directory. */
+    block_sector_t parent;              /* Parent's inode sector. */
+    struct index_entry index[ROOT_INDEX_CNT];
+  };
+
+/* Index block, mapping hashes to leaves. */
+struct dir_index
+  {
+    uint32_t type;                      /* INDEX_BLOCK. */
+    uint32_t cnt;                       /* Entries of INDEX in use. */
+    struct index_entry index[INDEX_CNT];
+  };
+
+/* Leaf block. */
+struct dir_leaf
+  {
+    uint32_t type;                      /* LEAF_BLOCK. */
+    uint32_t next;                      /* Overflow leaf, 0 if none. */
+    struct dir_entry entries[LEAF_CNT];
+    uint8_t unused[4];                  /* Not used. */
+  };
+
+/* The blocks from the root to the first leaf for a hash. */
+struct dir_path
+  {
+    struct dir_root root;               /* Block 0. */
+    size_t root_pos;                    /* Entry of ROOT followed. */
+    uint32_t index_block;               /* Index block, 0 if none. */
+    struct dir_index index;             /* Block INDEX_BLOCK. */
+    size_t index_pos;                   /* Entry of INDEX followed. */
+    uint32_t leaf_block;                /* First leaf for the hash. */
+    struct dir_leaf leaf;               /* Last leaf read. */
+  };
+
+/* Reads block BLOCK of DIR into BUF.
+   Returns false if DIR has no such block. */
+static bool
+read_block (const struct dir *dir, uint32_t block, void *buf)
+{
+  return (inode_read_at (dir->inode, buf, BLOCK_SECTOR_SIZE,
+                         block * BLOCK_SECTOR_SIZE)
+          == BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUF to block BLOCK of DIR, extending DIR if necessary.
+   Returns false if the disk is full. */
+static bool
+write_block (struct dir *dir, uint32_t block, const void *buf)
+{
+  return (inode_write_at (dir->inode, buf, BLOCK_SECTOR_SIZE,
+                          block * BLOCK_SECTOR_SIZE)
+          == BLOCK_SECTOR_SIZE);
+}
+
+/* Returns the hash of file name NAME. */
+static uint32_t
+name_hash (const char *name)
+{
+  return hash_string (name);
+}
+
+/* Returns the position of the last of the CNT entries of INDEX
+   whose range begins at or below HASH.  INDEX[0] must begin at
+   0. */
+static size_t
+find_pos (const struct index_entry index[], size_t cnt, uint32_t hash)
+{
+  size_t lo = 0, hi = cnt;
+
+  /* INDEX[LO].hash <= HASH, and INDEX[HI].hash > HASH if HI < CNT. */
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (index[mid].hash <= hash)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Reads the root and any index block of DIR into P and sets
+   P->leaf_block to the first leaf for HASH.
+   Returns false if DIR is not a valid directory. */
+static bool
+find_path (const struct dir *dir, uint32_t hash, struct dir_path *p)
+{
+  if (!read_block (dir, 0, &p->root) || p->root.magic != DIR_MAGIC)
+    return false;
+
+  p->root_pos = find_pos (p->root.index, p->root.cnt, hash);
+  p->leaf_block = p->root.index[p->root_pos].block;
+  p->index_block = 0;
+  if (p->root.depth > 0)
+    {
+      p->index_block = p->leaf_block;
+      if (!read_block (dir, p->index_block, &p->index))
+        return false;
+      p->index_pos = find_pos (p->index.index, p->index.cnt, hash);
+      p->leaf_block = p->index.index[p->index_pos].block;
+    }
+  return true;
+}
+
+/* Searches DIR for a file with the given NAME, using P to hold
+   the blocks read.
+   If successful, returns true, leaves the leaf that holds the
+   entry in P->leaf, and sets *BLOCKP and *SLOTP to the leaf's
+   block and the entry's position in it.
+   Otherwise, returns false and ignores BLOCKP and SLOTP. */
+static bool
+lookup (const struct dir *dir, const char *name, struct dir_path *p,
+        uint32_t *blockp, size_t *slotp)
+{
+  uint32_t block;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  if (!find_path (dir, name_hash (name), p))
+    return false;
+
+  for (block = p->leaf_block; block != 0; block = p->leaf.next)
+    {
+      size_t i;
+
+      if (!read_block (dir, block, &p->leaf))
+        return false;
+      for (i = 0; i < LEAF_CNT; i++)
+        if (p->leaf.entries[i].in_use
+            && !strcmp (name, p->leaf.entries[i].name))
+          {
+            *blockp = block;
+            *slotp = i;
+            return true;
+          }
+    }
+  return false;
+}
+
+/* Reads field OFS, a uint32_t, of the root block of the directory
+   in INODE. */
+static uint32_t
+read_root_field (struct inode *inode, off_t ofs)
+{
+  uint32_t value = 0;
+  inode_read_at (inode, &value, sizeof value, ofs);
+  return value;
+}
+
+/* Writes P->root.entry_cnt to DIR. */
+static bool
+write_entry_cnt (struct dir *dir, struct dir_path *p)
+{
+  off_t ofs = offsetof (struct dir_root, entry_cnt);
+  return (inode_write_at (dir->inode, &p->root.entry_cnt,
+                          sizeof p->root.entry_cnt, ofs)
+          == sizeof p->root.entry_cnt);
+}
+
+/* Creates a directory in the given SECTOR whose parent directory
+   has its inode in sector PARENT.  The root directory is its own
+   parent.  Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_root *root;
+  struct dir_leaf *leaf;
+  struct inode *inode = NULL;
+  bool success = false;
+
+  ASSERT (sizeof *root == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct dir_index) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof *leaf == BLOCK_SECTOR_SIZE);
+
+  root = calloc (1, sizeof *root);
+  leaf = calloc (1, sizeof *leaf);
+  journal_begin ();
+  if (root != NULL && leaf != NULL
+      && inode_create (sector, 2 * BLOCK_SECTOR_SIZE, true)
+      && (inode = inode_open (sector)) != NULL)
+    {
+      root->magic = DIR_MAGIC;
+      root->depth = 0;
+      root->cnt = 1;
+      root->index[0].hash = 0;
+      root->index[0].block = 1;
+      root->entry_cnt = 0;
+      root->block_cnt = 2;
+      root->parent = parent;
+      leaf->type = LEAF_BLOCK;
+
+      /* Both blocks are allocated, so neither write can fail. */
+      inode_write_at (inode, root, BLOCK_SECTOR_SIZE, 0);
+      inode_write_at (inode, leaf, BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+      success = true;
+    }
+  inode_close (inode);
+  journal_end ();
+  free (root);
+  free (leaf);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
    it takes ownership.  Returns a null pointer on failure. */
 struct dir *
-dir_open (struct inode *inode) 
+dir_open (struct inode *inode)
 {
   struct dir *dir = calloc (1, sizeof *dir);
   if (inode != NULL && dir != NULL)
@@ -45,7 +290,7 @@ dir_open (struct inode *inode)
     {
       inode_close (inode);
       free (dir);
-      return NULL; 
+      return NULL;
     }
 }
 
@@ -60,14 +305,14 @@ dir_open_root (void)
 /* Opens and returns a new directory for the same inode as DIR.
    Returns a null pointer on failure. */
 struct dir *
-dir_reopen (struct dir *dir) 
+dir_reopen (struct dir *dir)
 {
   return dir_open (inode_reopen (dir->inode));
 }
 
 /* Destroys DIR and frees associated resources. */
 void
-dir_close (struct dir *dir) 
+dir_close (struct dir *dir)
 {
   if (dir != NULL)
     {
@@ -78,159 +323,564 @@ dir_close (struct dir *dir)
 
 /* Returns the inode encapsulated by DIR. */
 struct inode *
-dir_get_inode (struct dir *dir) 
+dir_get_inode (struct dir *dir)
 {
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
-static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
-{
-  struct dir_entry e;
-  size_t ofs;
-  
-  ASSERT (dir != NULL);
-  ASSERT (name != NULL);
-
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
-}
-
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
+   "." names DIR itself and ".." its parent.  Other names are
+   looked up in the directory entry cache first.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
-            struct inode **inode) 
+            struct inode **inode)
 {
-  struct dir_entry e;
+  block_sector_t dir_sector, sector;
+  struct dir_path *p;
+  uint32_t block;
+  size_t slot;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  *inode = NULL;
+  dir_sector = inode_get_inumber (dir->inode);
+
+  /* dir_remove() marks DIR removed and purges its cache entries
+     with DIR locked, so checking under the lock keeps a lookup
+     from caching entries for a directory that is gone. */
+  inode_lock (dir->inode);
+  if (inode_is_removed (dir->inode))
+    goto done;
+
+  if (!strcmp (name, "."))
+    *inode = inode_reopen (dir->inode);
+  else if (!strcmp (name, ".."))
+    *inode = inode_open (read_root_field (dir->inode,
+                                          offsetof (struct dir_root,
+                                                    parent)));
+  else if (dcache_lookup (dir_sector, name, &sector))
+    *inode = sector != 0 ? inode_open (sector) : NULL;
   else
-    *inode = NULL;
+    {
+      p = malloc (sizeof *p);
+      if (p != NULL && lookup (dir, name, p, &block, &slot))
+        {
+          sector = p->leaf.entries[slot].inode_sector;
+          dcache_insert (dir_sector, name, sector);
+          *inode = inode_open (sector);
+        }
+      else if (p != NULL && strlen (name) <= NAME_MAX)
+        dcache_insert (dir_sector, name, 0);
+      free (p);
+    }
 
+ done:
+  inode_unlock (dir->inode);
   return *inode != NULL;
 }
 
+/* Searches the leaf for P's hash and its overflow leaves for a
+   free slot.  If successful, returns true, leaves the leaf with
+   the slot in P->leaf, and sets *BLOCKP and *SLOTP to its block
+   and the slot.  Otherwise, returns false, leaves the last leaf
+   in P->leaf, and sets *BLOCKP to its block and *CNTP to the
+   number of leaves. */
+static bool
+find_free_slot (const struct dir *dir, struct dir_path *p,
+                uint32_t *blockp, size_t *slotp, size_t *cntp)
+{
+  uint32_t block;
+
+  *cntp = 0;
+  for (block = p->leaf_block; block != 0; block = p->leaf.next)
+    {
+      size_t i;
+
+      if (!read_block (dir, block, &p->leaf))
+        return false;
+      *blockp = block;
+      ++*cntp;
+      for (i = 0; i < LEAF_CNT; i++)
+        if (!p->leaf.entries[i].in_use)
+          {
+            *slotp = i;
+            return true;
+          }
+    }
+  return false;
+}
+
+/* Appends BUF to DIR as a new block and writes P->root, which
+   records the new block count.  Returns the new block, or 0 if
+   the disk is full. */
+static uint32_t
+append_block (struct dir *dir, struct dir_path *p, const void *buf)
+{
+  uint32_t block = p->root.block_cnt;
+
+  if (!write_block (dir, block, buf))
+    return 0;
+  p->root.block_cnt++;
+  return block;
+}
+
+/* Inserts an entry for HASH and BLOCK at position POS of INDEX,
+   which has *CNT entries and room for one more. */
+static void
+insert_entry (struct index_entry index[], uint32_t *cnt, size_t pos,
+              uint32_t hash, uint32_t block)
+{
+  memmove (index + pos + 1, index + pos, (*cnt - pos) * sizeof *index);
+  index[pos].hash = hash;
+  index[pos].block = block;
+  ++*cnt;
+}
+
+/* Inserts an entry for HASH and BLOCK into the index above the
+   leaf in P, just after the entry that leads to that leaf, and
+   writes the index.  There must be room. */
+static bool
+insert_index (struct dir *dir, struct dir_path *p, uint32_t hash,
+              uint32_t block)
+{
+  if (p->root.depth == 0)
+    insert_entry (p->root.index, &p->root.cnt, p->root_pos + 1,
+                  hash, block);
+  else
+    {
+      insert_entry (p->index.index, &p->index.cnt, p->index_pos + 1,
+                    hash, block);
+      if (!write_block (dir, p->index_block, &p->index))
+        return false;
+    }
+  return write_block (dir, 0, &p->root);
+}
+
+/* Moves the root's index into two new index blocks, making room
+   in the root. */
+static bool
+grow_root (struct dir *dir, struct dir_path *p)
+{
+  struct dir_index *upper;
+  size_t half = p->root.cnt / 2;
+  uint32_t lower_block, upper_block;
+  bool success = false;
+
+  upper = calloc (1, sizeof *upper);
+  if (upper == NULL)
+    return false;
+
+  p->index.type = INDEX_BLOCK;
+  p->index.cnt = half;
+  memcpy (p->index.index, p->root.index, half * sizeof *p->index.index);
+  upper->type = INDEX_BLOCK;
+  upper->cnt = p->root.cnt - half;
+  memcpy (upper->index, p->root.index + half,
+          upper->cnt * sizeof *upper->index);
+
+  lower_block = append_block (dir, p, &p->index);
+  upper_block = lower_block != 0 ? append_block (dir, p, upper) : 0;
+  if (upper_block != 0)
+    {
+      p->root.depth = 1;
+      p->root.cnt = 2;
+      p->root.index[0].block = lower_block;
+      p->root.index[1].hash = upper->index[0].hash;
+      p->root.index[1].block = upper_block;
+      success = write_block (dir, 0, &p->root);
+    }
+  free (upper);
+  return success;
+}
+
+/* Moves the upper half of the full index block in P to a new
+   index block.  Fails if the root is full too, which limits a
+   directory to ROOT_INDEX_CNT * INDEX_CNT leaves. */
+static bool
+split_index (struct dir *dir, struct dir_path *p)
+{
+  struct dir_index *upper;
+  size_t half = p->index.cnt / 2;
+  uint32_t block;
+  bool success = false;
+
+  if (p->root.cnt == ROOT_INDEX_CNT)
+    return false;
+  upper = calloc (1, sizeof *upper);
+  if (upper == NULL)
+    return false;
+
+  upper->type = INDEX_BLOCK;
+  upper->cnt = p->index.cnt - half;
+  memcpy (upper->index, p->index.index + half,
+          upper->cnt * sizeof *upper->index);
+  p->index.cnt = half;
+
+  block = append_block (dir, p, upper);
+  if (block != 0)
+    {
+      insert_entry (p->root.index, &p->root.cnt, p->root_pos + 1,
+                    upper->index[0].hash, block);
+      success = (write_block (dir, p->index_block, &p->index)
+                 && write_block (dir, 0, &p->root));
+    }
+  free (upper);
+  return success;
+}
+
+/* Compares hashes A and B, for qsort(). */
+static int
+compare_hashes (const void *a_, const void *b_)
+{
+  const uint32_t *a = a_;
+  const uint32_t *b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Reads the CNT leaves chained from the first leaf for P's hash,
+   and returns them in an array that the caller must free, with
+   their blocks in BLOCKS, which has room for CNT + 1.  Returns a
+   null pointer if out of memory or on a disk error. */
+static struct dir_leaf *
+read_chain (const struct dir *dir, const struct dir_path *p, size_t cnt,
+            uint32_t blocks[])
+{
+  struct dir_leaf *leaves;
+  size_t i;
+
+  leaves = calloc (cnt + 1, sizeof *leaves);
+  if (leaves == NULL)
+    return NULL;
+  blocks[0] = p->leaf_block;
+  for (i = 0; i < cnt; i++)
+    {
+      if (!read_block (dir, blocks[i], &leaves[i]))
+        {
+          free (leaves);
+          return NULL;
+        }
+      blocks[i + 1] = leaves[i].next;
+    }
+  return leaves;
+}
+
+/* Chooses the hash at which to split the CNT full leaves in
+   LEAVES so that a new entry with hash HASH fits on one side or
+   the other, and stores it in *SPLITP.  HASHES must have room for
+   every entry and HASH.  Returns false if their entries and HASH
+   are all the same, so that they cannot be split. */
+static bool
+choose_split (const struct dir_leaf leaves[], size_t cnt, uint32_t hash,
+              uint32_t hashes[], uint32_t *splitp)
+{
+  size_t n = cnt * LEAF_CNT + 1;
+  size_t i;
+
+  for (i = 0; i < n - 1; i++)
+    hashes[i] = name_hash (leaves[i / LEAF_CNT].entries[i % LEAF_CNT].name);
+  hashes[n - 1] = hash;
+  qsort (hashes, n, sizeof *hashes, compare_hashes);
+
+  /* Split at the median, or above it if that is also the smallest
+     hash, which must stay on the lower side. */
+  for (i = n / 2; i < n; i++)
+    if (hashes[i] != hashes[0])
+      {
+        *splitp = hashes[i];
+        return true;
+      }
+  return false;
+}
+
+/* Moves the entries of the CNT full leaves in LEAVES, chained
+   from the first leaf for P's hash and kept in BLOCKS, whose
+   hashes are SPLIT or greater to a chain of their own.  The
+   leaves' blocks are reused for both chains, and at most one new
+   block is appended to the directory. */
+static bool
+split_chain (struct dir *dir, struct dir_path *p, struct dir_leaf leaves[],
+             size_t cnt, uint32_t blocks[], uint32_t split)
+{
+  struct dir_entry *entries;
+  struct dir_leaf *out;
+  size_t n = cnt * LEAF_CNT;
+  size_t lower_cnt = 0, lower_leaves, upper_leaves, total;
+  size_t lower_pos, upper_pos, i;
+  bool success = false;
+
+  entries = malloc (n * sizeof *entries);
+  out = calloc (cnt + 1, sizeof *out);
+  if (entries == NULL || out == NULL)
+    goto done;
+  for (i = 0; i < n; i++)
+    {
+      entries[i] = leaves[i / LEAF_CNT].entries[i % LEAF_CNT];
+      if (name_hash (entries[i].name) < split)
+        lower_cnt++;
+    }
+
+  /* Each side keeps at least one leaf, for the new entry. */
+  lower_leaves = lower_cnt > 0 ? DIV_ROUND_UP (lower_cnt, LEAF_CNT) : 1;
+  upper_leaves = n > lower_cnt ? DIV_ROUND_UP (n - lower_cnt, LEAF_CNT) : 1;
+  total = lower_leaves + upper_leaves;
+  ASSERT (total <= cnt + 1);
+  blocks[cnt] = p->root.block_cnt;
+
+  lower_pos = 0;
+  upper_pos = lower_leaves * LEAF_CNT;
+  for (i = 0; i < n; i++)
+    {
+      size_t *pos = name_hash (entries[i].name) < split ? &lower_pos : &upper_pos;
+      out[*pos / LEAF_CNT].entries[*pos % LEAF_CNT] = entries[i];
+      ++*pos;
+    }
+  for (i = 0; i < total; i++)
+    {
+      out[i].type = LEAF_BLOCK;
+      out[i].next = (i + 1 == lower_leaves || i + 1 == total
+                     ? 0 : blocks[i + 1]);
+    }
+
+  if (total > cnt && append_block (dir, p, &out[cnt]) != blocks[cnt])
+    goto done;
+  for (i = 0; i < total && i < cnt; i++)
+    if (!write_block (dir, blocks[i], &out[i]))
+      goto done;
+  success = insert_index (dir, p, split, blocks[lower_leaves]);
+
+ done:
+  free (out);
+  free (entries);
+  return success;
+}
+
+/* Chains a new overflow leaf to TAIL, the last leaf for P's hash,
+   which is in P->leaf. */
+static bool
+chain_leaf (struct dir *dir, struct dir_path *p, uint32_t tail)
+{
+  struct dir_leaf *leaf;
+  bool success = false;
+
+  leaf = calloc (1, sizeof *leaf);
+  if (leaf == NULL)
+    return false;
+
+  leaf->type = LEAF_BLOCK;
+  p->leaf.next = append_block (dir, p, leaf);
+  success = (p->leaf.next != 0
+             && write_block (dir, tail, &p->leaf)
+             && write_block (dir, 0, &p->root));
+  free (leaf);
+  return success;
+}
+
+/* Makes room for an entry with hash HASH in DIR, whose CNT leaves
+   for that hash are all full and end at TAIL, which is in
+   P->leaf.  Returns false if DIR cannot grow. */
+static bool
+make_room (struct dir *dir, struct dir_path *p, uint32_t hash,
+           size_t cnt, uint32_t tail)
+{
+  struct dir_leaf *leaves = NULL;
+  uint32_t *blocks, *hashes;
+  uint32_t split;
+  bool success = false;
+
+  blocks = malloc ((cnt + 1) * sizeof *blocks);
+  hashes = malloc ((cnt * LEAF_CNT + 1) * sizeof *hashes);
+  if (blocks != NULL && hashes != NULL)
+    leaves = read_chain (dir, p, cnt, blocks);
+  if (leaves == NULL)
+    success = false;
+  else if (!choose_split (leaves, cnt, hash, hashes, &split))
+    success = chain_leaf (dir, p, tail);
+  else if (p->root.depth == 0 && p->root.cnt == ROOT_INDEX_CNT)
+    success = grow_root (dir, p);
+  else if (p->root.depth == 1 && p->index.cnt == INDEX_CNT)
+    success = split_index (dir, p);
+  else
+    success = split_chain (dir, p, leaves, cnt, blocks, split);
+  free (leaves);
+  free (hashes);
+  free (blocks);
+  return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if DIR has been
+   removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-  struct dir_entry e;
-  off_t ofs;
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  block_sector_t sector;
+  struct dir_path *p;
+  struct dir_entry *e;
+  uint32_t hash, block;
+  size_t slot, leaf_cnt;
   bool success = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (*name == '\0' || strlen (name) > NAME_MAX
+      || !strcmp (name, ".") || !strcmp (name, ".."))
     return false;
 
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  journal_begin ();
+  inode_lock (dir->inode);
+
+  /* A removed directory takes no new entries. */
+  if (inode_is_removed (dir->inode))
+    goto done;
+
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  if (dcache_lookup (dir_sector, name, &sector)
+      ? sector != 0
+      : lookup (dir, name, p, &block, &slot))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Find a free slot, splitting or chaining leaves until there is
+     one.  Each split halves a chain of leaves, so this ends. */
+  hash = name_hash (name);
+  for (;;)
+    {
+      if (!find_path (dir, hash, p))
+        goto done;
+      if (find_free_slot (dir, p, &block, &slot, &leaf_cnt))
+        break;
+      if (!make_room (dir, p, hash, leaf_cnt, block))
+        goto done;
+    }
 
   /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  e = &p->leaf.entries[slot];
+  e->in_use = true;
+  strlcpy (e->name, name, sizeof e->name);
+  e->inode_sector = inode_sector;
+  p->root.entry_cnt++;
+  success = write_block (dir, block, &p->leaf) && write_entry_cnt (dir, p);
+  if (success)
+    dcache_insert (dir_sector, name, inode_sector);
 
  done:
+  inode_unlock (dir->inode);
+  journal_end ();
+  free (p);
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs only if there is no file with the given NAME or
+   if it is a directory that is not empty. */
 bool
-dir_remove (struct dir *dir, const char *name) 
+dir_remove (struct dir *dir, const char *name)
 {
-  struct dir_entry e;
+  struct dir_path *p;
   struct inode *inode = NULL;
+  bool is_dir = false;
   bool success = false;
-  off_t ofs;
+  uint32_t block;
+  size_t slot;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  journal_begin ();
+  inode_lock (dir->inode);
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, p, &block, &slot))
     goto done;
 
   /* Open inode. */
-  inode = inode_open (e.inode_sector);
+  inode = inode_open (p->leaf.entries[slot].inode_sector);
   if (inode == NULL)
     goto done;
 
+  /* Only an empty directory may be removed.  Holding its lock
+     keeps entries from being added until it is marked removed.
+     Locks are always taken parent first. */
+  is_dir = inode_is_dir (inode);
+  if (is_dir)
+    {
+      inode_lock (inode);
+      if (read_root_field (inode, offsetof (struct dir_root, entry_cnt)) != 0)
+        goto done;
+    }
+
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  p->leaf.entries[slot].in_use = false;
+  p->root.entry_cnt--;
+  if (!write_block (dir, block, &p->leaf) || !write_entry_cnt (dir, p))
     goto done;
 
-  /* Remove inode. */
+  /* Remove inode, and anything cached about it. */
+  dcache_insert (inode_get_inumber (dir->inode), name, 0);
+  if (is_dir)
+    dcache_purge (inode_get_inumber (inode));
   inode_remove (inode);
   success = true;
 
  done:
+  if (is_dir)
+    inode_unlock (inode);
   inode_close (inode);
+  inode_unlock (dir->inode);
+  journal_end ();
+  free (p);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  Entries come in the order of the
+   leaves on disk, and "." and ".." are not returned. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
-  struct dir_entry e;
+  struct dir_leaf *leaf;
+  bool found = false;
+
+  leaf = malloc (sizeof *leaf);
+  if (leaf == NULL)
+    return false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  /* DIR->pos counts LEAF_CNT positions per block, from block 1. */
+  inode_lock (dir->inode);
+  if (dir->pos < LEAF_CNT)
+    dir->pos = LEAF_CNT;
+  while (!found && read_block (dir, dir->pos / LEAF_CNT, leaf))
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
+      size_t slot = dir->pos % LEAF_CNT;
+
+      if (leaf->type != LEAF_BLOCK)
+        slot = LEAF_CNT;
+      for (; slot < LEAF_CNT && !found; slot++)
+        if (leaf->entries[slot].in_use)
+          {
+            strlcpy (name, leaf->entries[slot].name, NAME_MAX + 1);
+            found = true;
+          }
+      dir->pos = dir->pos / LEAF_CNT * LEAF_CNT + slot;
     }
-  return false;
+  inode_unlock (dir->inode);
+  free (leaf);
+  return found;
 }
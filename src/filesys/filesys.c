@@ -2,15 +2,24 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static bool allocate_inode (struct dir *, bool is_dir, block_sector_t *);
+static struct dir *open_parent (const char *path, char name[NAME_MAX + 1]);
+static struct inode *open_path (const char *path);
+static bool create (const char *path, off_t initial_size, bool is_dir);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,7 +30,11 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  journal_init (format);
+  dcache_init ();
   inode_init ();
+  file_init ();
   free_map_init ();
 
   if (format) 
@@ -30,73 +43,270 @@ filesys_init (bool format)
   free_map_open ();
 }
 
-/* Shuts down the file system module, writing any unwritten data
-   to disk. */
+/* Shuts down the file system module, committing the journal and
+   writing any unwritten data to disk, including the delayed data
+   of files still open. */
 void
 filesys_done (void) 
 {
+  /* Writing needs interrupts, which are off after a kernel panic. */
+  bool writing = intr_get_level () == INTR_ON;
+
+  if (writing)
+    inode_flush_all ();
   free_map_close ();
+  if (writing)
+    {
+      journal_commit ();
+      cache_flush ();
+    }
 }
 
-/* Creates a file named NAME with the given INITIAL_SIZE.
+/* Creates a file named PATH with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
-   Fails if a file named NAME already exists,
-   or if internal memory allocation fails. */
+   Fails if a file named PATH already exists, if a directory on
+   the way to it does not, or if internal memory allocation
+   fails. */
 bool
-filesys_create (const char *name, off_t initial_size) 
+filesys_create (const char *path, off_t initial_size) 
 {
-  block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return create (path, initial_size, false);
+}
 
-  return success;
+/* Creates an empty directory named PATH.
+   Returns true if successful, false otherwise. */
+bool
+filesys_mkdir (const char *path)
+{
+  return create (path, 0, true);
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file or directory with the given PATH.
    Returns the new file if successful or a null pointer
    otherwise.
-   Fails if no file named NAME exists,
+   Fails if no file named PATH exists,
    or if an internal memory allocation fails. */
 struct file *
-filesys_open (const char *name)
+filesys_open (const char *path)
 {
-  struct dir *dir = dir_open_root ();
-  struct inode *inode = NULL;
-
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
-
-  return file_open (inode);
+  return file_open (open_path (path));
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory named PATH.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named PATH exists, if it is a directory that
+   is not empty or the root directory, or if an internal memory
+   allocation fails. */
 bool
-filesys_remove (const char *name) 
+filesys_remove (const char *path) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char name[NAME_MAX + 1];
+  struct dir *dir = open_parent (path, name);
+  bool success = dir != NULL && *name != '\0' && dir_remove (dir, name);
   dir_close (dir); 
 
   return success;
 }
-
+
+/* Makes the directory named PATH the current thread's working
+   directory.  Returns true if successful, false if PATH does not
+   name a directory. */
+bool
+filesys_chdir (const char *path)
+{
+  struct thread *t = thread_current ();
+  struct inode *inode = open_path (path);
+  struct dir *dir;
+
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+
+  dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
+/* Creates a file, or a directory if IS_DIR is true, named PATH
+   with the given INITIAL_SIZE, in one journaled operation, or
+   more for a file too large for one, which inode_grow() grows
+   the rest of the way. */
+static bool
+create (const char *path, off_t initial_size, bool is_dir)
+{
+  char name[NAME_MAX + 1];
+  block_sector_t inode_sector = 0;
+  struct dir *dir = open_parent (path, name);
+  bool created = false;
+  bool success = false;
+
+  journal_begin ();
+  if (dir != NULL && *name != '\0'
+      && allocate_inode (dir, is_dir, &inode_sector))
+    {
+      if (is_dir)
+        created = dir_create (inode_sector,
+                              inode_get_inumber (dir_get_inode (dir)));
+      else
+        created = inode_create (inode_sector, initial_size, false);
+      success = created && dir_add (dir, name, inode_sector);
+    }
+
+  if (!success && created)
+    {
+      /* Frees the inode's sector along with its data. */
+      struct inode *inode = inode_open (inode_sector);
+      if (inode != NULL)
+        inode_remove (inode);
+      inode_close (inode);
+    }
+  else if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  journal_end ();
+
+  if (success && !is_dir)
+    {
+      struct inode *inode = inode_open (inode_sector);
+      success = inode != NULL && inode_grow (inode, initial_size);
+      inode_close (inode);
+      if (!success)
+        dir_remove (dir, name);
+    }
+  dir_close (dir);
+
+  return success;
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX characters from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Opens the directory that contains the last component of PATH
+   and copies that component into NAME.  PATH is relative to the
+   current thread's working directory unless it begins with '/'.
+   If PATH has no components, as "/" does, opens the directory it
+   names and sets NAME to "".
+   Returns a null pointer if PATH is empty, if a directory on the
+   way does not exist, or if a component is too long. */
+static struct dir *
+open_parent (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *cwd = thread_current ()->cwd;
+  struct dir *dir;
+  char next[NAME_MAX + 1];
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+  dir = *path == '/' || cwd == NULL ? dir_open_root () : dir_reopen (cwd);
+
+  result = get_next_part (name, &path);
+  if (result == 0)
+    *name = '\0';
+  while (result > 0 && dir != NULL)
+    {
+      struct inode *inode;
+
+      result = get_next_part (next, &path);
+      if (result <= 0)
+        break;
+
+      /* NAME is a directory on the way to the last component. */
+      dir_lookup (dir, name, &inode);
+      dir_close (dir);
+      dir = NULL;
+      if (inode != NULL && inode_is_dir (inode))
+        dir = dir_open (inode);
+      else
+        inode_close (inode);
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+
+  if (result < 0)
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
+
+/* Opens the inode of the file or directory named PATH.
+   Returns a null pointer if there is none. */
+static struct inode *
+open_path (const char *path)
+{
+  char name[NAME_MAX + 1];
+  struct dir *dir = open_parent (path, name);
+  struct inode *inode = NULL;
+
+  if (dir == NULL)
+    return NULL;
+  if (*name == '\0')
+    inode = inode_reopen (dir_get_inode (dir));
+  else
+    dir_lookup (dir, name, &inode);
+  dir_close (dir);
+
+  return inode;
+}
+
+/* Allocates a sector for the inode of a new file in directory
+   DIR and stores it in *SECTORP.  A file goes near DIR's inode,
+   and its data follows its inode, so that the files of a
+   directory stay together.  A directory goes to the allocation
+   group with the most free sectors instead, so that directories
+   spread over the disk and leave room for their files.
+   Returns false if the disk is full. */
+static bool
+allocate_inode (struct dir *dir, bool is_dir, block_sector_t *sectorp)
+{
+  block_sector_t goal = (is_dir
+                         ? free_map_spread_goal ()
+                         : inode_get_inumber (dir_get_inode (dir)));
+  return free_map_allocate_near (1, goal, sectorp);
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
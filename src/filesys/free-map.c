@@ -1,79 +1,301 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <list.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The free map is kept on disk as a bitmap with one bit per
+   sector.  To allocate without scanning the bitmap, its runs of
+   free sectors are also kept in memory as a list of extents
+   sorted by first sector.  Each change to the bitmap is written
+   to the free map file at once, only for the bytes that changed,
+   so that the journal commits it along with the operation that
+   made it.
+
+   For locality the disk is divided into allocation groups of
+   GROUP_SECTORS sectors.  An allocation with a goal takes the
+   first free sectors at or after the goal in the goal's group,
+   then in the groups that follow, so that related data ends up
+   close together.  Other allocations are taken best fit.
+
+   Sectors may also be reserved, without choosing them yet, for
+   data whose allocation is delayed.  Other allocations leave
+   enough free sectors for the reservations. */
+
+/* Sectors per allocation group. */
+#define GROUP_SECTORS 512
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* A run of free sectors. */
+struct free_extent
+  {
+    struct list_elem elem;           /* Element in extents. */
+    block_sector_t start;            /* First sector. */
+    size_t cnt;                      /* Number of sectors. */
+  };
+
+/* Free extents, sorted by start, never adjacent to each other. */
+static struct list extents;
+
+/* True if some free sectors are in no extent because there was no
+   memory for one.  The extents are then built again from the free
+   map before the next allocation. */
+static bool extents_lost;
+
+/* Number of allocation groups, and the number of free sectors in
+   each. */
+static size_t group_cnt;
+static size_t *group_free;
+
+/* Number of free sectors, and how many of them are reserved. */
+static size_t free_cnt, reserved_cnt;
+
+/* Protects everything above. */
+static struct lock free_map_lock;
+
+static void build_extents (void);
+static void add_extent (block_sector_t, size_t);
+static struct free_extent *find_fit (block_sector_t lo, block_sector_t hi,
+                                     size_t cnt, block_sector_t *);
+static bool take (struct free_extent *, block_sector_t, size_t);
+static bool allocate_best (size_t, block_sector_t *);
+static bool allocate_near (size_t, block_sector_t goal, bool reserved,
+                           block_sector_t *);
+static void count_free (block_sector_t, size_t, int);
+static void write_bits (block_sector_t, size_t);
+
 /* Initializes the free map. */
 void
-free_map_init (void) 
+free_map_init (void)
 {
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_free = calloc (group_cnt, sizeof *group_free);
+  if (group_free == NULL)
+    PANIC ("allocation group creation failed");
+
+  list_init (&extents);
+  lock_init (&free_map_lock);
+  build_extents ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Takes them from the smallest run of
+   free sectors that is large enough, to keep large runs for large
+   requests.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = free_cnt - reserved_cnt >= cnt && allocate_best (cnt, sectorp);
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Allocates CNT consecutive sectors as close after sector GOAL as
+   possible and stores the first into *SECTORP.  Looks in GOAL's
+   allocation group first, then in the groups that follow, and
+   falls back to free_map_allocate().
+   Returns true if successful, false if not enough consecutive
+   sectors were available. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t goal,
+                        block_sector_t *sectorp)
+{
+  return allocate_near (cnt, goal, false, sectorp);
+}
+
+/* Like free_map_allocate_near(), but takes the CNT sectors from
+   those reserved by free_map_reserve().  Fails only if they are
+   not consecutive. */
+bool
+free_map_allocate_reserved (size_t cnt, block_sector_t goal,
+                            block_sector_t *sectorp)
+{
+  return allocate_near (cnt, goal, true, sectorp);
+}
+
+/* Reserves CNT sectors for data that will be allocated later.
+   Returns false if not enough sectors are free. */
+bool
+free_map_reserve (size_t cnt)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = free_cnt - reserved_cnt >= cnt;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Gives back CNT sectors reserved by free_map_reserve(). */
+void
+free_map_unreserve (size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt >= cnt);
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
+}
+
+/* Allocates CNT consecutive sectors from the smallest run of free
+   sectors that is large enough and stores the first into
+   *SECTORP.  Returns false if there is none.  Must be called with
+   free_map_lock held. */
+static bool
+allocate_best (size_t cnt, block_sector_t *sectorp)
+{
+  struct free_extent *best = NULL;
+  struct list_elem *e;
+  block_sector_t start = 0;
+  bool success;
+
+  if (extents_lost)
+    build_extents ();
+  for (e = list_begin (&extents); e != list_end (&extents); e = list_next (e))
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      struct free_extent *x = list_entry (e, struct free_extent, elem);
+      if (x->cnt >= cnt && (best == NULL || x->cnt < best->cnt))
+        {
+          best = x;
+          if (x->cnt == cnt)
+            break;
+        }
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+
+  if (best != NULL)
+    start = best->start;
+  success = best != NULL && take (best, start, cnt);
+  if (success)
+    *sectorp = start;
+  return success;
+}
+
+/* Allocates CNT consecutive sectors as free_map_allocate_near()
+   does, from the reserved sectors if RESERVED is true. */
+static bool
+allocate_near (size_t cnt, block_sector_t goal, bool reserved,
+               block_sector_t *sectorp)
+{
+  size_t goal_group = goal / GROUP_SECTORS;
+  bool success = false;
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  ASSERT (!reserved || reserved_cnt >= cnt);
+  if (!reserved && free_cnt - reserved_cnt < cnt)
+    goto done;
+  if (extents_lost)
+    build_extents ();
+
+  for (i = 0; i < group_cnt && goal_group < group_cnt; i++)
+    {
+      size_t group = (goal_group + i) % group_cnt;
+      block_sector_t lo = group * GROUP_SECTORS;
+      block_sector_t hi = lo + GROUP_SECTORS;
+      struct free_extent *x;
+      block_sector_t start;
+
+      if (group_free[group] < cnt)
+        continue;
+      x = i == 0 ? find_fit (goal, hi, cnt, &start) : NULL;
+      if (x == NULL)
+        x = find_fit (lo, hi, cnt, &start);
+      if (x != NULL && take (x, start, cnt))
+        {
+          *sectorp = start;
+          success = true;
+          break;
+        }
+    }
+  if (!success)
+    success = allocate_best (cnt, sectorp);
+  if (success && reserved)
+    reserved_cnt -= cnt;
+
+ done:
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Returns the first sector of the allocation group with the most
+   free sectors, a goal that spreads unrelated data, such as new
+   directories, over the disk. */
+block_sector_t
+free_map_spread_goal (void)
+{
+  size_t best = 0;
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  for (i = 1; i < group_cnt; i++)
+    if (group_free[i] > group_free[best])
+      best = i;
+  lock_release (&free_map_lock);
+  return best * GROUP_SECTORS;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  write_bits (sector, cnt);
+  count_free (sector, cnt, 1);
+  add_extent (sector, cnt);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
 void
-free_map_open (void) 
+free_map_open (void)
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  build_extents ();
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Closes the free map file. */
 void
-free_map_close (void) 
+free_map_close (void)
 {
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void
-free_map_create (void) 
+free_map_create (void)
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -83,3 +305,189 @@ free_map_create (void)
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Replaces the free extents and the free sector counts of the
+   allocation groups by those of the free map.  Leaves extents_lost
+   set if there still is not enough memory for every extent. */
+static void
+build_extents (void)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start = 0;
+  size_t i;
+
+  while (!list_empty (&extents))
+    free (list_entry (list_pop_front (&extents), struct free_extent, elem));
+  extents_lost = false;
+
+  for (i = 0; i < group_cnt; i++)
+    {
+      size_t lo = i * GROUP_SECTORS;
+      size_t cnt = size - lo < GROUP_SECTORS ? size - lo : GROUP_SECTORS;
+      group_free[i] = bitmap_count (free_map, lo, cnt, false);
+    }
+  free_cnt = bitmap_count (free_map, 0, size, false);
+
+  while ((start = bitmap_scan (free_map, start, 1, false)) != BITMAP_ERROR)
+    {
+      size_t end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = size;
+      add_extent (start, end - start);
+      start = end;
+    }
+}
+
+/* Adds the CNT free sectors starting at START to the free
+   extents, merging them with the extents before and after.  If
+   out of memory, sets extents_lost instead: the sectors are free
+   in the free map, and are found again when the extents are
+   rebuilt from it.  Must be called with free_map_lock held, except
+   during initialization. */
+static void
+add_extent (block_sector_t start, size_t cnt)
+{
+  struct free_extent *prev = NULL, *next = NULL, *x;
+  struct list_elem *e;
+
+  for (e = list_begin (&extents); e != list_end (&extents); e = list_next (e))
+    {
+      x = list_entry (e, struct free_extent, elem);
+      if (x->start > start)
+        {
+          next = x;
+          break;
+        }
+      prev = x;
+    }
+
+  if (prev != NULL && prev->start + prev->cnt == start)
+    {
+      prev->cnt += cnt;
+      if (next != NULL && start + cnt == next->start)
+        {
+          prev->cnt += next->cnt;
+          list_remove (&next->elem);
+          free (next);
+        }
+    }
+  else if (next != NULL && start + cnt == next->start)
+    {
+      next->start = start;
+      next->cnt += cnt;
+    }
+  else
+    {
+      x = malloc (sizeof *x);
+      if (x == NULL)
+        {
+          extents_lost = true;
+          return;
+        }
+      x->start = start;
+      x->cnt = cnt;
+      if (next != NULL)
+        list_insert (&next->elem, &x->elem);
+      else
+        list_push_back (&extents, &x->elem);
+    }
+}
+
+/* Returns the first extent with CNT free sectors that starts
+   before HI, counting only its sectors from LO onward, and stores
+   the first of those sectors in *STARTP.  Returns a null pointer
+   if there is none.  Must be called with free_map_lock held. */
+static struct free_extent *
+find_fit (block_sector_t lo, block_sector_t hi, size_t cnt,
+          block_sector_t *startp)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&extents); e != list_end (&extents); e = list_next (e))
+    {
+      struct free_extent *x = list_entry (e, struct free_extent, elem);
+      block_sector_t start = x->start > lo ? x->start : lo;
+
+      if (x->start >= hi)
+        break;
+      if (start < x->start + x->cnt && x->start + x->cnt - start >= cnt)
+        {
+          *startp = start;
+          return x;
+        }
+    }
+  return NULL;
+}
+
+/* Marks the CNT sectors starting at START, which lie within free
+   extent X, as allocated.  Returns false if that would split X
+   and there is no memory for the second half.  Must be called
+   with free_map_lock held. */
+static bool
+take (struct free_extent *x, block_sector_t start, size_t cnt)
+{
+  block_sector_t end = x->start + x->cnt;
+
+  ASSERT (start >= x->start && start + cnt <= end);
+
+  if (start > x->start && start + cnt < end)
+    {
+      struct free_extent *after = malloc (sizeof *after);
+      if (after == NULL)
+        return false;
+      after->start = start + cnt;
+      after->cnt = end - after->start;
+      list_insert (list_next (&x->elem), &after->elem);
+      x->cnt = start - x->start;
+    }
+  else if (start > x->start)
+    x->cnt -= cnt;
+  else
+    {
+      x->start += cnt;
+      x->cnt -= cnt;
+      if (x->cnt == 0)
+        {
+          list_remove (&x->elem);
+          free (x);
+        }
+    }
+
+  ASSERT (bitmap_none (free_map, start, cnt));
+  bitmap_set_multiple (free_map, start, cnt, true);
+  write_bits (start, cnt);
+  count_free (start, cnt, -1);
+  return true;
+}
+
+/* Adds DELTA to the free sector counts of the allocation groups
+   for each of the CNT sectors starting at START. */
+static void
+count_free (block_sector_t start, size_t cnt, int delta)
+{
+  while (cnt > 0)
+    {
+      size_t group = start / GROUP_SECTORS;
+      size_t in_group = (group + 1) * GROUP_SECTORS - start;
+      size_t n = cnt < in_group ? cnt : in_group;
+
+      group_free[group] += delta * (int) n;
+      free_cnt += delta * (int) n;
+      start += n;
+      cnt -= n;
+    }
+}
+
+/* Writes the bits of the CNT sectors starting at START to the
+   free map file, unless it is still being created.  Must be
+   called with free_map_lock held, within a journaled
+   operation. */
+static void
+write_bits (block_sector_t start, size_t cnt)
+{
+  size_t first = start / CHAR_BIT;
+  size_t last = (start + cnt - 1) / CHAR_BIT;
+
+  if (free_map_file != NULL)
+    bitmap_write_part (free_map, free_map_file, first, last - first + 1);
+}
@@ -1,23 +1,69 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of data sector pointers in an inode, and in an indirect
+   block. */
+#define DIRECT_CNT 123
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Largest file, in sectors: the direct sectors, those of the
+   indirect block, and those of the indirect blocks of the doubly
+   indirect block. */
+#define MAX_SECTORS \
+  (DIRECT_CNT + PTRS_PER_SECTOR + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
+/* Most sectors of a file kept in memory without sectors on disk.
+
+   A write that grows a file does not allocate sectors for the
+   data it adds, up to this many.  It reserves them in the free
+   map and keeps the data in memory, and the sectors are allocated
+   together when the data is flushed: by the buffer cache's flush
+   thread, when the file is closed by its last opener or synced,
+   or when there is too much of it.  A file written in small
+   appends thus ends up in runs of consecutive sectors.  Indirect
+   blocks are allocated at once, and only regular files are
+   delayed. */
+#define DELAY_MAX 64
+
+/* Most sectors of delayed data of all files together.  A write
+   that would go over allocates sectors for the delayed data of
+   its file instead of adding to it. */
+#define DELAY_TOTAL_MAX 256
+
+/* Most sectors a file grows by in one journaled operation, so
+   that the indirect blocks it changes fit in the journal's room
+   for the operation.  A larger write grows the file in several
+   operations. */
+#define GROW_MAX 512
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Every sector below the length of the file is allocated.  A
+   pointer of 0 means no sector, since sector 0 always holds the
+   free map's inode. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t direct[DIRECT_CNT];  /* First data sectors. */
+    block_sector_t indirect;            /* Block of pointers to more. */
+    block_sector_t doubly_indirect;     /* Block of indirect blocks. */
     off_t length;                       /* File size in bytes. */
+    uint32_t is_dir;                    /* Nonzero for a directory. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,54 +74,491 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Most closed inodes kept in memory. */
+#define CLOSED_INODE_MAX 64
+
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* Element in inodes. */
+    struct list_elem elem;              /* Element in closed_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool loading;                       /* DATA is being read. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rw_semaphore rw;             /* Shared to read and write, and
+                                           exclusive to extend DATA. */
+    struct lock lock;                   /* See inode_lock(). */
     struct inode_disk data;             /* Inode content. */
+    off_t length;                       /* Length including delayed data. */
+    uint8_t **delayed;                  /* Data of the sectors after
+                                           DATA's, if LENGTH is greater. */
+    size_t delayed_cnt;                 /* Number of delayed sectors. */
+    struct list_elem delayed_elem;      /* Element in delayed_inodes. */
   };
 
+/* Returns pointer IDX of indirect block SECTOR. */
+static block_sector_t
+read_ptr (block_sector_t sector, size_t idx)
+{
+  block_sector_t ptr;
+  cache_read (sector, &ptr, idx * sizeof ptr, sizeof ptr);
+  return ptr;
+}
+
+/* Returns the indirect block that holds the pointer to data
+   sector IDX of the file described by DISK, which must be past
+   the direct sectors, and stores the pointer's index in it in
+   *SLOT.  The indirect block must be allocated. */
+static block_sector_t
+ptr_block (const struct inode_disk *disk, size_t idx, size_t *slot)
+{
+  ASSERT (idx >= DIRECT_CNT);
+  idx -= DIRECT_CNT;
+  *slot = idx % PTRS_PER_SECTOR;
+  if (idx < PTRS_PER_SECTOR)
+    return disk->indirect;
+  idx -= PTRS_PER_SECTOR;
+  return read_ptr (disk->doubly_indirect, idx / PTRS_PER_SECTOR);
+}
+
+/* Returns the sector that holds data sector IDX of the file
+   described by DISK.  That sector must be allocated. */
+static block_sector_t
+index_to_sector (const struct inode_disk *disk, size_t idx)
+{
+  block_sector_t block;
+  size_t slot;
+
+  if (idx < DIRECT_CNT)
+    return disk->direct[idx];
+  block = ptr_block (disk, idx, &slot);
+  return read_ptr (block, slot);
+}
+
+/* Allocates a sector of zeros as close after GOAL as possible
+   and stores it in *SECTORP, unless *SECTORP already names a
+   sector.  The sector is an indirect block if INDEX is true, and
+   file data otherwise.  Returns false if the disk is full. */
+static bool
+allocate_zeroed (block_sector_t *sectorp, block_sector_t goal, bool index)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (*sectorp != 0)
+    return true;
+  if (!free_map_allocate_near (1, goal, sectorp))
+    return false;
+  if (index)
+    cache_write_meta (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  else
+    cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Stores pointer IDX of indirect block SECTOR in *PTRP,
+   allocating a sector near GOAL for it first if it has none, as
+   allocate_zeroed() does with INDEX.  Returns false if the disk
+   is full. */
+static bool
+allocate_ptr (block_sector_t sector, size_t idx, block_sector_t goal,
+              bool index, block_sector_t *ptrp)
+{
+  *ptrp = read_ptr (sector, idx);
+  if (*ptrp != 0)
+    return true;
+  if (!allocate_zeroed (ptrp, goal, index))
+    return false;
+  cache_write_meta (sector, ptrp, idx * sizeof *ptrp, sizeof *ptrp);
+  return true;
+}
+
+/* Allocates the indirect blocks that lead to data sector IDX of
+   the file described by DISK, where they are missing, as close
+   after GOAL as possible.  Returns false if the disk is full. */
+static bool
+allocate_indirect (struct inode_disk *disk, size_t idx, block_sector_t goal)
+{
+  block_sector_t ptr;
+
+  if (idx < DIRECT_CNT)
+    return true;
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    return allocate_zeroed (&disk->indirect, goal, true);
+  idx -= PTRS_PER_SECTOR;
+  return (allocate_zeroed (&disk->doubly_indirect, goal, true)
+          && allocate_ptr (disk->doubly_indirect, idx / PTRS_PER_SECTOR,
+                           goal, true, &ptr));
+}
+
+/* Allocates data sector IDX of the file described by DISK, and
+   the indirect blocks that lead to it, where they are missing,
+   as close after GOAL as possible.  Returns false if the disk is
+   full. */
+static bool
+allocate_index (struct inode_disk *disk, size_t idx, block_sector_t goal)
+{
+  block_sector_t block, ptr;
+  size_t slot;
+
+  if (!allocate_indirect (disk, idx, goal))
+    return false;
+  if (idx < DIRECT_CNT)
+    return allocate_zeroed (&disk->direct[idx], goal, false);
+  block = ptr_block (disk, idx, &slot);
+  return allocate_ptr (block, slot, goal, false, &ptr);
+}
+
+/* Makes SECTOR data sector IDX of the file described by DISK.
+   The indirect blocks that lead to it must be allocated. */
+static void
+set_index (struct inode_disk *disk, size_t idx, block_sector_t sector)
+{
+  block_sector_t block;
+  size_t slot;
+
+  if (idx < DIRECT_CNT)
+    disk->direct[idx] = sector;
+  else
+    {
+      block = ptr_block (disk, idx, &slot);
+      cache_write_meta (block, &sector, slot * sizeof sector, sizeof sector);
+    }
+}
+
+/* Grows the file described by DISK, whose inode is in sector
+   INODE_SECTOR, to LENGTH bytes, allocating the sectors it gains.
+   Each sector is placed right after the one before, or after the
+   inode for the first, if there is room.  Returns false, leaving
+   the length unchanged, if LENGTH is too large or the disk fills
+   up.  The sectors allocated so far stay in the index in that
+   case and are found again by the next attempt. */
+static bool
+extend (struct inode_disk *disk, block_sector_t inode_sector, off_t length)
+{
+  size_t sectors = bytes_to_sectors (length);
+  size_t i = bytes_to_sectors (disk->length);
+  block_sector_t goal;
+
+  if (sectors > MAX_SECTORS)
+    return false;
+  goal = i > 0 ? index_to_sector (disk, i - 1) + 1 : inode_sector + 1;
+  for (; i < sectors; i++)
+    {
+      if (!allocate_index (disk, i, goal))
+        return false;
+      goal = index_to_sector (disk, i) + 1;
+    }
+  disk->length = length;
+  return true;
+}
+
+/* Frees indirect block SECTOR and the sectors it points to, which
+   are indirect blocks themselves if LEVELS is greater than 1. */
+static void
+release_indirect (block_sector_t sector, int levels)
+{
+  block_sector_t ptrs[PTRS_PER_SECTOR];
+  size_t i;
+
+  cache_read (sector, ptrs, 0, BLOCK_SECTOR_SIZE);
+  for (i = 0; i < PTRS_PER_SECTOR; i++)
+    if (ptrs[i] != 0)
+      {
+        if (levels > 1)
+          release_indirect (ptrs[i], levels - 1);
+        else
+          free_map_release (ptrs[i], 1);
+      }
+  free_map_release (sector, 1);
+}
+
+/* Frees every data sector and indirect block of the file
+   described by DISK. */
+static void
+release_sectors (const struct inode_disk *disk)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      free_map_release (disk->direct[i], 1);
+  if (disk->indirect != 0)
+    release_indirect (disk->indirect, 1);
+  if (disk->doubly_indirect != 0)
+    release_indirect (disk->doubly_indirect, 2);
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, or keeps it in memory. */
 static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  if (pos < inode->length && idx < bytes_to_sectors (inode->data.length))
+    return index_to_sector (&inode->data, idx);
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns the data INODE keeps in memory for the sector that
+   contains byte offset POS, which must be delayed. */
+static uint8_t *
+delayed_sector (const struct inode *inode, off_t pos)
+{
+  size_t idx = pos / BLOCK_SECTOR_SIZE - bytes_to_sectors (inode->data.length);
+
+  ASSERT (idx < inode->delayed_cnt);
+  return inode->delayed[idx];
+}
+
+/* In-memory inodes by sector, so that opening a single inode
+   twice returns the same `struct inode'.  Besides the open inodes,
+   these include the most recently closed ones, which keep their
+   on-disk inode so that reopening them needs no disk read. */
+static struct hash inodes;
+
+/* Closed inodes in INODES, from most to least recently closed. */
+static struct list closed_inodes;
+static size_t closed_cnt;
+
+/* Inodes with delayed data, and their delayed sectors. */
+static struct list delayed_inodes;
+static size_t delayed_total;
+
+/* Protects the above and the open_cnt, removed and loading
+   members of every inode. */
+static struct lock inodes_lock;
+
+/* Signaled with inodes_lock held when an inode has been read. */
+static struct condition inode_loaded;
+
+/* In-memory inodes, which malloc() would round up to 1 kB. */
+static struct slab_cache inode_cache;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static off_t write_part (struct inode *, const uint8_t *, off_t size,
+                         off_t offset);
+static bool charge_delayed (size_t);
+static void uncharge_delayed (size_t);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&inodes, inode_hash, inode_less, NULL))
+    PANIC ("inode_init: cannot allocate hash table");
+  list_init (&closed_inodes);
+  list_init (&delayed_inodes);
+  lock_init (&inodes_lock);
+  cond_init (&inode_loaded);
+  slab_cache_init (&inode_cache, "inode", sizeof (struct inode), NULL);
+}
+
+/* Hashes an inode by its sector. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, hash_elem)->sector);
+}
+
+/* Orders inodes by sector. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, hash_elem)->sector
+          < hash_entry (b, struct inode, hash_elem)->sector);
+}
+
+/* Grows INODE, a regular file, to LENGTH bytes, keeping the data
+   of the sectors it gains in memory, zeroed, and reserving
+   sectors for them.  Returns false, leaving INODE unchanged, if
+   it would keep more than DELAY_MAX sectors that way or if
+   memory or disk space runs out.  Must be called with INODE's rw
+   held exclusively, within a journaled operation. */
+static bool
+delay (struct inode *inode, off_t length)
+{
+  struct inode_disk *disk = &inode->data;
+  block_sector_t indirect = disk->indirect;
+  block_sector_t doubly_indirect = disk->doubly_indirect;
+  size_t first = bytes_to_sectors (disk->length);
+  size_t cnt = bytes_to_sectors (length) - first;
+  size_t old_cnt = inode->delayed_cnt;
+  block_sector_t goal;
+  size_t i;
+
+  if (cnt > DELAY_MAX || first + cnt > MAX_SECTORS)
+    return false;
+  if (cnt > old_cnt)
+    {
+      if (inode->delayed == NULL)
+        {
+          inode->delayed = calloc (DELAY_MAX, sizeof *inode->delayed);
+          if (inode->delayed == NULL)
+            return false;
+        }
+      if (!charge_delayed (cnt - old_cnt))
+        return false;
+      if (!free_map_reserve (cnt - old_cnt))
+        {
+          uncharge_delayed (cnt - old_cnt);
+          return false;
+        }
+
+      goal = first > 0 ? index_to_sector (disk, first - 1) + 1 : inode->sector + 1;
+      for (i = old_cnt; i < cnt; i++)
+        if (!allocate_indirect (disk, first + i, goal)
+            || (inode->delayed[i] = calloc (1, BLOCK_SECTOR_SIZE)) == NULL)
+          break;
+      if (disk->indirect != indirect
+          || disk->doubly_indirect != doubly_indirect)
+        cache_write_meta (inode->sector, disk, 0, BLOCK_SECTOR_SIZE);
+
+      /* The indirect blocks stay, as they do when extend() fails. */
+      if (i < cnt)
+        {
+          while (i-- > old_cnt)
+            {
+              free (inode->delayed[i]);
+              inode->delayed[i] = NULL;
+            }
+          free_map_unreserve (cnt - old_cnt);
+          uncharge_delayed (cnt - old_cnt);
+          return false;
+        }
+      inode->delayed_cnt = cnt;
+    }
+
+  if (inode->length == disk->length)
+    {
+      lock_acquire (&inodes_lock);
+      list_push_back (&delayed_inodes, &inode->delayed_elem);
+      lock_release (&inodes_lock);
+    }
+  inode->length = length;
+  return true;
+}
+
+/* Allocates sectors for the delayed data of INODE, consecutive
+   ones if possible, right after its last sector if possible,
+   writes the data to them and updates the inode on disk.  Must
+   be called with INODE's rw held exclusively, within a journaled
+   operation. */
+static void
+allocate_delayed (struct inode *inode)
+{
+  struct inode_disk *disk = &inode->data;
+  size_t first = bytes_to_sectors (disk->length);
+  block_sector_t goal, run;
+  bool consecutive;
+  size_t i;
+
+  if (inode->length == disk->length)
+    return;
+
+  goal = first > 0 ? index_to_sector (disk, first - 1) + 1 : inode->sector + 1;
+  consecutive = (inode->delayed_cnt > 0
+                 && free_map_allocate_reserved (inode->delayed_cnt, goal, &run));
+  for (i = 0; i < inode->delayed_cnt; i++)
+    {
+      block_sector_t sector = run + i;
+
+      /* The sectors are reserved, so these cannot fail. */
+      if (!consecutive && !free_map_allocate_reserved (1, goal, &sector))
+        PANIC ("reserved sector not available");
+      cache_write (sector, inode->delayed[i], 0, BLOCK_SECTOR_SIZE);
+      set_index (disk, first + i, sector);
+      free (inode->delayed[i]);
+      inode->delayed[i] = NULL;
+      goal = sector + 1;
+    }
+
+  disk->length = inode->length;
+  cache_write_meta (inode->sector, disk, 0, BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&inodes_lock);
+  list_remove (&inode->delayed_elem);
+  delayed_total -= inode->delayed_cnt;
+  lock_release (&inodes_lock);
+  inode->delayed_cnt = 0;
+}
+
+/* Frees the delayed data of INODE, which is removed and no longer
+   open, along with its reserved sectors. */
+static void
+discard_delayed (struct inode *inode)
+{
+  size_t i;
+
+  for (i = 0; i < inode->delayed_cnt; i++)
+    free (inode->delayed[i]);
+  free_map_unreserve (inode->delayed_cnt);
+  uncharge_delayed (inode->delayed_cnt);
+  free (inode->delayed);
+}
+
+/* Counts CNT more sectors of delayed data, unless that would make
+   more than DELAY_TOTAL_MAX, in which case returns false. */
+static bool
+charge_delayed (size_t cnt)
+{
+  bool success;
+
+  lock_acquire (&inodes_lock);
+  success = delayed_total + cnt <= DELAY_TOTAL_MAX;
+  if (success)
+    delayed_total += cnt;
+  lock_release (&inodes_lock);
+  return success;
+}
+
+/* Counts CNT fewer sectors of delayed data. */
+static void
+uncharge_delayed (size_t cnt)
+{
+  lock_acquire (&inodes_lock);
+  delayed_total -= cnt;
+  lock_release (&inodes_lock);
+}
+
+/* Returns the in-memory inode for SECTOR, or a null pointer if
+   there is none. */
+static struct inode *
+find_inode (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&inodes, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct inode, hash_elem) : NULL;
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+/* Initializes an inode with LENGTH bytes of data, or only the
+   first GROW_MAX sectors of them, and writes the new inode to
+   sector SECTOR on the file system device, in one journaled
+   operation.  inode_grow() adds the rest.  The inode is a
+   directory if IS_DIR is true.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
 
   ASSERT (length >= 0);
+  if (length > GROW_MAX * BLOCK_SECTOR_SIZE)
+    length = GROW_MAX * BLOCK_SECTOR_SIZE;
 
   /* If this assertion fails, the inode structure is not exactly
      one sector in size, and you should fix that. */
@@ -84,60 +567,88 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->is_dir = is_dir;
+      journal_begin ();
+      if (extend (disk_inode, sector, length)) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          cache_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
           success = true; 
         } 
+      else
+        release_sectors (disk_inode);
+      journal_end ();
       free (disk_inode);
     }
   return success;
 }
 
+/* Counts one more opener of INODE, taking it off the closed
+   inodes if it had none.  Must be called with inodes_lock
+   held. */
+static void
+add_opener (struct inode *inode)
+{
+  if (inode->open_cnt == 0)
+    {
+      list_remove (&inode->elem);
+      closed_cnt--;
+    }
+  inode->open_cnt++;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
+   Returns a null pointer if memory allocation fails.
+   The inode is entered in INODES before it is read, so that
+   the read does not hold inodes_lock.  Others opening it
+   meanwhile wait for the read to finish. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&inodes_lock);
+
+  /* Check whether this inode is already in memory. */
+  inode = find_inode (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      add_opener (inode);
+      while (inode->loading)
+        cond_wait (&inode_loaded, &inodes_lock);
+      lock_release (&inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = slab_alloc (&inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->loading = true;
+  inode->delayed = NULL;
+  inode->delayed_cnt = 0;
+  rwsema_init (&inode->rw);
+  lock_init (&inode->lock);
+  hash_insert (&inodes, &inode->hash_elem);
+  lock_release (&inodes_lock);
+
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  inode->length = inode->data.length;
+
+  lock_acquire (&inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &inodes_lock);
+  lock_release (&inodes_lock);
   return inode;
 }
 
@@ -146,7 +657,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inodes_lock);
+      inode->open_cnt++;
+      lock_release (&inodes_lock);
+    }
   return inode;
 }
 
@@ -157,9 +672,26 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
-/* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
+}
+
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Closes INODE.
+   If this was the last reference to INODE, allocates sectors for
+   its delayed data, and it stays in memory until more than
+   CLOSED_INODE_MAX inodes are closed after it.
+   If INODE was also a removed inode, frees its memory and its
+   blocks at once. */
 void
 inode_close (struct inode *inode) 
 {
@@ -167,22 +699,51 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
+  /* The last opener flushes, and checks again afterward, since
+     the inode may have been reopened and written meanwhile. */
+  lock_acquire (&inodes_lock);
+  while (inode->open_cnt == 1 && !inode->removed
+         && inode->length != inode->data.length)
+    {
+      lock_release (&inodes_lock);
+      inode_flush (inode);
+      lock_acquire (&inodes_lock);
+    }
+
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed.  No one else can find the
+         inode once it is out of the table. */
       if (inode->removed) 
         {
+          hash_delete (&inodes, &inode->hash_elem);
+          if (inode->length != inode->data.length)
+            list_remove (&inode->delayed_elem);
+          lock_release (&inodes_lock);
+          discard_delayed (inode);
+          journal_begin ();
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (&inode->data);
+          journal_end ();
+          slab_free (inode);
+          return;
         }
 
-      free (inode); 
+      /* Otherwise keep it, forgetting the least recently closed
+         inode if there are too many. */
+      list_push_front (&closed_inodes, &inode->elem);
+      if (++closed_cnt > CLOSED_INODE_MAX)
+        {
+          struct inode *old = list_entry (list_pop_back (&closed_inodes),
+                                          struct inode, elem);
+          closed_cnt--;
+          hash_delete (&inodes, &old->hash_elem);
+          free (old->delayed);
+          slab_free (old);
+        }
     }
+  lock_release (&inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,19 +752,22 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inodes_lock);
   inode->removed = true;
+  lock_release (&inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   The sector that follows the last one read is read ahead. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  down_read (&inode->rw);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -220,50 +784,138 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      if (sector_idx != (block_sector_t) -1)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memcpy (buffer + bytes_read, delayed_sector (inode, offset) + sector_ofs,
+                chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  if (bytes_read > 0)
+    {
+      off_t next = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+      if (next < inode->data.length)
+        cache_read_ahead (byte_to_sector (inode, next));
+    }
+  up_read (&inode->rw);
 
   return bytes_read;
 }
 
+/* Returns the length that INODE can grow to in one journaled
+   operation. */
+static off_t
+grow_limit (const struct inode *inode)
+{
+  return (ROUND_DOWN (inode_length (inode), BLOCK_SECTOR_SIZE)
+          + GROW_MAX * BLOCK_SECTOR_SIZE);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if an error occurs.  A write past end of file
+   extends the inode, unless the disk is full, in which case only
+   the bytes before end of file are written.  The data a regular
+   file gains may be delayed (see DELAY_MAX).  The data of
+   directories and of the free map is metadata, and is journaled
+   like the inode itself.
+
+   A write that grows INODE by more than GROW_MAX sectors does so
+   in several journaled operations, first with zeros up to OFFSET
+   and then with the data.  Within a journaled operation, such as
+   a directory's, they would all be one, so a write there must
+   grow INODE by less. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
-  if (inode->deny_write_cnt)
+  if (offset >= grow_limit (inode) && !inode_grow (inode, offset))
     return 0;
+  do
+    {
+      off_t limit = grow_limit (inode) - offset;
+      off_t chunk = size < limit ? size : limit;
+      off_t written = write_part (inode, buffer + bytes_written, chunk,
+                                  offset);
+
+      bytes_written += written;
+      if (written < chunk)
+        break;
+      size -= written;
+      offset += written;
+    }
+  while (size > 0);
+  return bytes_written;
+}
+
+/* Grows INODE with zeros to LENGTH bytes, if it is shorter, in
+   as many journaled operations as that takes.  Returns false if
+   the disk fills up or writes to INODE are denied first, possibly
+   leaving INODE grown part of the way. */
+bool
+inode_grow (struct inode *inode, off_t length)
+{
+  while (inode_length (inode) < length)
+    {
+      off_t end = grow_limit (inode);
+
+      if (end > length)
+        end = length;
+      write_part (inode, NULL, 0, end);
+      if (inode_length (inode) < end)
+        return false;
+    }
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   for inode_write_at(), in one journaled operation if it grows
+   INODE, which it must not by more than GROW_MAX sectors. */
+static off_t
+write_part (struct inode *inode, const uint8_t *buffer, off_t size,
+            off_t offset)
+{
+  off_t bytes_written = 0;
+  bool extending, meta;
+
+  /* A write that extends the file holds the inode exclusively
+     until its data is written, so that readers never see the new
+     length before the data.  Others share it, since the length
+     only grows. */
+  extending = offset + size > inode_length (inode);
+  meta = inode->data.is_dir || inode->sector == FREE_MAP_SECTOR;
+  if (extending || meta)
+    journal_begin ();
+  if (extending)
+    down_write (&inode->rw);
+  else
+    down_read (&inode->rw);
+
+  if (inode->deny_write_cnt)
+    goto done;
+
+  if (offset + size > inode->length && !meta
+      && !delay (inode, offset + size))
+    {
+      /* Too much delayed data: give it sectors and try again. */
+      allocate_delayed (inode);
+      delay (inode, offset + size);
+    }
+  if (offset + size > inode->length)
+    {
+      /* Sectors may be allocated even if growing fails. */
+      extend (&inode->data, inode->sector, offset + size);
+      inode->length = inode->data.length;
+      cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+    }
 
   while (size > 0) 
     {
@@ -281,39 +933,29 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      if (sector_idx == (block_sector_t) -1)
+        memcpy (delayed_sector (inode, offset) + sector_ofs,
+                buffer + bytes_written, chunk_size);
+      else if (meta)
+        cache_write_meta (sector_idx, buffer + bytes_written, sector_ofs,
+                          chunk_size);
+      else
+        cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                     chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+ done:
+  if (extending)
+    up_write (&inode->rw);
+  else
+    up_read (&inode->rw);
+  if (extending || meta)
+    journal_end ();
   return bytes_written;
 }
 
@@ -322,8 +964,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  down_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  up_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +976,92 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  down_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  up_write (&inode->rw);
+}
+
+/* Acquires INODE's lock.  A directory holds it while it searches
+   or changes its entries.  The read and write system calls hold a
+   regular file's for the whole call, so that each is atomic with
+   respect to the others, though it may copy user memory, fault
+   pages in and begin journaled operations meanwhile.  Nothing
+   else takes a regular file's lock, so none of that waits for
+   it. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's lock. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
+}
+
+/* Allocates sectors for INODE's delayed data. */
+void
+inode_flush (struct inode *inode)
+{
+  if (inode->length == inode->data.length)
+    return;
+  journal_begin ();
+  down_write (&inode->rw);
+  allocate_delayed (inode);
+  up_write (&inode->rw);
+  journal_end ();
+}
+
+/* Allocates sectors for the delayed data of every inode that has
+   some. */
+void
+inode_flush_all (void)
+{
+  size_t cnt;
+
+  lock_acquire (&inodes_lock);
+  cnt = list_size (&delayed_inodes);
+  lock_release (&inodes_lock);
+
+  /* Inodes that get delayed data meanwhile wait for the next
+     time. */
+  while (cnt-- > 0)
+    {
+      struct inode *inode = NULL;
+
+      lock_acquire (&inodes_lock);
+      if (!list_empty (&delayed_inodes))
+        {
+          inode = list_entry (list_front (&delayed_inodes),
+                              struct inode, delayed_elem);
+          add_opener (inode);
+        }
+      lock_release (&inodes_lock);
+      if (inode == NULL)
+        break;
+
+      inode_flush (inode);
+      inode_close (inode);
+    }
+}
+
+/* Writes INODE's data to disk along with every committed change
+   to the file system, including INODE's own. */
+void
+inode_sync (struct inode *inode)
+{
+  inode_flush (inode);
+  journal_sync ();
+  cache_flush ();
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
 {
-  return inode->data.length;
+  return inode->length;
 }
@@ -0,0 +1,486 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/shutdown.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal of file system metadata.
+
+   Inodes, indirect blocks, directories and the free map are
+   metadata.  An operation that changes metadata runs between
+   journal_begin() and journal_end(), and the sectors it changes
+   join the running transaction instead of being written in place.
+   A transaction gathers the changes of many operations and is
+   committed as a whole: when it reaches COMMIT_SECTORS sectors,
+   every time the cache is flushed, and at shutdown.
+
+   A transaction must fit in the journal.  An operation reserves
+   room for the most sectors it may change when it begins, and
+   waits, or commits the running transaction, until there is
+   that much room.
+
+   A commit waits for the operations in progress to end and holds
+   off new ones.  It writes dirty file data first, so that
+   committed metadata never points to data that is not on disk,
+   then writes the transaction to the journal: a descriptor that
+   lists its sectors, their contents, and a commit block with a
+   checksum of both.  Only then are the sectors written in place,
+   after which the journal header moves on to the next
+   transaction.  At boot, a transaction found complete in the
+   journal is written in place again, which is all the recovery
+   there is to do.
+
+   Until it is committed, a sector of the transaction must not
+   reach its place on disk.  The buffer cache does not write it
+   back, and if it has to evict it, hands a copy to the journal,
+   which gives it back when the sector is read again. */
+
+/* Magic numbers of the journal's blocks. */
+#define HEADER_MAGIC 0x4a524e4c
+#define DESC_MAGIC 0x44455343
+#define COMMIT_MAGIC 0x434d4954
+
+/* Most sectors of a transaction that fit in the journal, after
+   the header, the descriptor and the commit block. */
+#define JOURNAL_CAPACITY (JOURNAL_SECTORS - 3)
+
+/* Sectors in the running transaction that cause a commit. */
+#define COMMIT_SECTORS 64
+
+/* Most sectors an operation changes besides the free map's:
+   directory leaves and index blocks, two inodes, and the
+   indirect blocks of a file grown by at most GROW_MAX sectors
+   (see inode.c). */
+#define OP_SECTORS 32
+
+/* Journal header, in sector JOURNAL_SECTOR. */
+struct journal_header
+  {
+    unsigned magic;                     /* HEADER_MAGIC. */
+    uint32_t seq;                       /* Next transaction's number. */
+    uint32_t unused[126];               /* Not used. */
+  };
+
+/* Descriptor of a transaction, in the sector after the header.
+   The contents of its sectors follow, then its commit block. */
+struct journal_desc
+  {
+    unsigned magic;                     /* DESC_MAGIC. */
+    uint32_t seq;                       /* Transaction's number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    block_sector_t sectors[JOURNAL_CAPACITY];  /* Their places. */
+  };
+
+/* Commit block of a transaction. */
+struct commit_block
+  {
+    unsigned magic;                     /* COMMIT_MAGIC. */
+    uint32_t seq;                       /* Transaction's number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    unsigned checksum;                  /* See write_transaction(). */
+    uint32_t unused[124];               /* Not used. */
+  };
+
+/* A sector of the running transaction. */
+struct txn_sector
+  {
+    block_sector_t sector;              /* Sector number. */
+    uint8_t *copy;                      /* Contents while evicted from
+                                           the cache, or null. */
+  };
+
+/* Sectors of the running transaction. */
+static struct txn_sector txn[JOURNAL_CAPACITY];
+static size_t txn_cnt;
+
+/* Sectors reserved by an operation when it begins, and those
+   reserved by the operations in progress but not yet added to
+   the transaction. */
+static size_t op_credits;
+static size_t reserved_credits;
+
+/* Number of the next transaction. */
+static uint32_t seq;
+
+/* Operations in progress, and whether a commit is. */
+static int active_cnt;
+static bool committing;
+
+/* Protects everything above. */
+static struct lock journal_lock;
+
+/* Signaled when an operation ends, and when a commit ends. */
+static struct condition op_ended;
+static struct condition commit_done;
+
+/* -jcrash=N: Power off, as a power failure would, once the Nth
+   fsync() that commits anything has written its transaction to
+   the journal and before it is written in place, so that the
+   next boot has to replay it. */
+int journal_crash;
+
+/* Buffers for reading and writing the journal, used by one
+   commit at a time. */
+static struct journal_header header;
+static struct journal_desc desc;
+static struct commit_block commit;
+static uint8_t block[BLOCK_SECTOR_SIZE];
+
+/* Statistics. */
+static unsigned long long op_cnt, commit_cnt, logged_cnt;
+
+static void replay (void);
+static void commit_transaction (bool sync);
+static void write_transaction (bool crash);
+static struct txn_sector *find_sector (block_sector_t);
+
+/* Initializes the journal.  If FORMAT is true, writes an empty
+   journal, otherwise writes in place the last transaction in the
+   journal if it was committed. */
+void
+journal_init (bool format)
+{
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof desc == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof commit == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&op_ended);
+  cond_init (&commit_done);
+
+  /* An operation may change every sector of the free map. */
+  op_credits = OP_SECTORS + DIV_ROUND_UP (block_size (fs_device),
+                                          BLOCK_SECTOR_SIZE * 8);
+  if (op_credits > JOURNAL_CAPACITY)
+    PANIC ("journal too small for a %"PRDSNu"-sector file system",
+           block_size (fs_device));
+
+  if (format)
+    {
+      header.magic = HEADER_MAGIC;
+      header.seq = 1;
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+      memset (&desc, 0, sizeof desc);
+      block_write (fs_device, JOURNAL_SECTOR + 1, &desc);
+    }
+  else
+    replay ();
+  seq = header.seq;
+}
+
+/* Starts an operation that changes metadata and reserves room
+   in the journal for its sectors, waiting if a commit is in
+   progress or there is not enough room.  Operations nest, and
+   only the outermost one may wait, which it must do holding no
+   file system locks. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth > 0)
+    {
+      t->journal_depth++;
+      return;
+    }
+
+  lock_acquire (&journal_lock);
+  while (committing || txn_cnt >= COMMIT_SECTORS
+         || txn_cnt + reserved_credits + op_credits > JOURNAL_CAPACITY)
+    {
+      if (committing)
+        cond_wait (&commit_done, &journal_lock);
+      else if (txn_cnt == 0)
+        {
+          /* Only the reservations of others are in the way. */
+          cond_wait (&op_ended, &journal_lock);
+        }
+      else
+        {
+          lock_release (&journal_lock);
+          journal_commit ();
+          lock_acquire (&journal_lock);
+        }
+    }
+  active_cnt++;
+  op_cnt++;
+  reserved_credits += op_credits;
+  lock_release (&journal_lock);
+  t->journal_depth = 1;
+  t->journal_credits = op_credits;
+}
+
+/* Ends an operation started by journal_begin().  The outermost
+   one commits the running transaction if it is large. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+  bool full;
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  active_cnt--;
+  reserved_credits -= t->journal_credits;
+  t->journal_credits = 0;
+  cond_broadcast (&op_ended, &journal_lock);
+  full = txn_cnt >= COMMIT_SECTORS && !committing;
+  lock_release (&journal_lock);
+
+  if (full)
+    journal_commit ();
+}
+
+/* Commits the running transaction and writes its sectors in
+   place.  Must not be called by an operation in progress. */
+void
+journal_commit (void)
+{
+  commit_transaction (false);
+}
+
+/* Commits the running transaction for fsync(), like
+   journal_commit(). */
+void
+journal_sync (void)
+{
+  commit_transaction (true);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void)
+{
+  printf ("Journal: %llu operations, %llu commits, %llu sectors logged\n",
+          op_cnt, commit_cnt, logged_cnt);
+}
+
+/* Commits the running transaction, for fsync() if SYNC is
+   true. */
+static void
+commit_transaction (bool sync)
+{
+  bool crash;
+
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&commit_done, &journal_lock);
+  if (txn_cnt == 0)
+    {
+      lock_release (&journal_lock);
+      return;
+    }
+  committing = true;
+  crash = sync && journal_crash > 0 && --journal_crash == 0;
+  while (active_cnt > 0)
+    cond_wait (&op_ended, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* No operation can add to the transaction now. */
+  write_transaction (crash);
+
+  lock_acquire (&journal_lock);
+  txn_cnt = 0;
+  committing = false;
+  commit_cnt++;
+  cond_broadcast (&commit_done, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Adds SECTOR, which the running operation changed, to the
+   running transaction, using up one of the sectors the operation
+   reserved, or room that nobody reserved if it has none left. */
+void
+journal_add (block_sector_t sector)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  ASSERT (find_sector (sector) == NULL);
+  if (t->journal_credits > 0)
+    {
+      t->journal_credits--;
+      reserved_credits--;
+    }
+  else if (txn_cnt + reserved_credits >= JOURNAL_CAPACITY)
+    PANIC ("journal: operation changed more sectors than it reserved");
+  txn[txn_cnt].sector = sector;
+  txn[txn_cnt].copy = NULL;
+  txn_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Keeps DATA as the contents of SECTOR, a sector of the running
+   transaction that the cache evicts. */
+void
+journal_save (block_sector_t sector, const void *data)
+{
+  struct txn_sector *s;
+
+  lock_acquire (&journal_lock);
+  s = find_sector (sector);
+  ASSERT (s != NULL);
+  if (s->copy == NULL)
+    {
+      s->copy = malloc (BLOCK_SECTOR_SIZE);
+      if (s->copy == NULL)
+        PANIC ("journal: out of memory");
+    }
+  memcpy (s->copy, data, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+}
+
+/* If the journal keeps the contents of SECTOR, copies them into
+   DATA and returns true.  Otherwise returns false, and SECTOR's
+   contents are on disk. */
+bool
+journal_load (block_sector_t sector, void *data)
+{
+  struct txn_sector *s;
+  bool found;
+
+  lock_acquire (&journal_lock);
+  s = find_sector (sector);
+  found = s != NULL && s->copy != NULL;
+  if (found)
+    memcpy (data, s->copy, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+  return found;
+}
+
+/* Frees the contents of SECTOR kept by the journal, once SECTOR
+   is written in place. */
+void
+journal_forget (block_sector_t sector)
+{
+  struct txn_sector *s;
+
+  lock_acquire (&journal_lock);
+  s = find_sector (sector);
+  if (s != NULL)
+    {
+      free (s->copy);
+      s->copy = NULL;
+    }
+  lock_release (&journal_lock);
+}
+
+/* Writes the transaction in the journal in place, if the journal
+   header names it and its commit block and checksum are
+   intact. */
+static void
+replay (void)
+{
+  unsigned checksum;
+  size_t i;
+
+  block_read (fs_device, JOURNAL_SECTOR, &header);
+  if (header.magic != HEADER_MAGIC)
+    PANIC ("no journal found--file system needs formatting");
+
+  block_read (fs_device, JOURNAL_SECTOR + 1, &desc);
+  if (desc.magic != DESC_MAGIC || desc.seq != header.seq
+      || desc.cnt > JOURNAL_CAPACITY)
+    return;
+  block_read (fs_device, JOURNAL_SECTOR + 2 + desc.cnt, &commit);
+  if (commit.magic != COMMIT_MAGIC || commit.seq != desc.seq
+      || commit.cnt != desc.cnt)
+    return;
+
+  checksum = hash_bytes (&desc, sizeof desc);
+  for (i = 0; i < desc.cnt; i++)
+    {
+      block_read (fs_device, JOURNAL_SECTOR + 2 + i, block);
+      checksum = checksum * 31 + hash_bytes (block, sizeof block);
+    }
+  if (checksum != commit.checksum)
+    return;
+
+  for (i = 0; i < desc.cnt; i++)
+    {
+      block_read (fs_device, JOURNAL_SECTOR + 2 + i, block);
+      block_write (fs_device, desc.sectors[i], block);
+    }
+  header.seq++;
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+  printf ("journal: replayed %"PRIu32" sectors\n", desc.cnt);
+}
+
+/* Commits the running transaction and writes its sectors in
+   place.  If CRASH is true, powers off instead of writing them in
+   place.  Called only by commit_transaction(), without
+   journal_lock, while no operation is in progress. */
+static void
+write_transaction (bool crash)
+{
+  size_t i;
+
+  ASSERT (txn_cnt <= JOURNAL_CAPACITY);
+
+  cache_flush ();
+
+  memset (&desc, 0, sizeof desc);
+  desc.magic = DESC_MAGIC;
+  desc.seq = seq;
+  desc.cnt = txn_cnt;
+  for (i = 0; i < txn_cnt; i++)
+    desc.sectors[i] = txn[i].sector;
+  block_write (fs_device, JOURNAL_SECTOR + 1, &desc);
+
+  memset (&commit, 0, sizeof commit);
+  commit.checksum = hash_bytes (&desc, sizeof desc);
+  for (i = 0; i < txn_cnt; i++)
+    {
+      cache_read (txn[i].sector, block, 0, sizeof block);
+      block_write (fs_device, JOURNAL_SECTOR + 2 + i, block);
+      commit.checksum = (commit.checksum * 31
+                         + hash_bytes (block, sizeof block));
+    }
+  commit.magic = COMMIT_MAGIC;
+  commit.seq = seq;
+  commit.cnt = txn_cnt;
+  block_write (fs_device, JOURNAL_SECTOR + 2 + txn_cnt, &commit);
+  logged_cnt += txn_cnt;
+
+  if (crash)
+    {
+      printf ("journal: crashing before writing %zu sectors in place\n",
+              txn_cnt);
+      shutdown_crash ();
+    }
+
+  for (i = 0; i < txn_cnt; i++)
+    cache_write_back (txn[i].sector);
+
+  header.seq = ++seq;
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Returns the running transaction's entry for SECTOR, or a null
+   pointer if it has none.  Must be called with journal_lock
+   held. */
+static struct txn_sector *
+find_sector (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < txn_cnt; i++)
+    if (txn[i].sector == sector)
+      return &txn[i];
+  return NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of sectors reserved for the journal, starting at
+   JOURNAL_SECTOR. */
+#define JOURNAL_SECTORS 128
+
+extern int journal_crash;
+
+void journal_init (bool format);
+void journal_begin (void);
+void journal_end (void);
+void journal_commit (void);
+void journal_sync (void);
+void journal_print_stats (void);
+
+/* For the buffer cache. */
+void journal_add (block_sector_t);
+void journal_save (block_sector_t, const void *);
+bool journal_load (block_sector_t, void *);
+void journal_forget (block_sector_t);
+
+#endif /* filesys/journal.h */
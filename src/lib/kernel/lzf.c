@@ -0,0 +1,170 @@
+#include "lzf.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Encoding.
+
+   Each element of the compressed data starts with a control
+   byte C.  If C < 32, it is followed by C + 1 literal bytes.
+   Otherwise C >> 5 is the length of a back reference less 2,
+   where 7 means that the next byte holds the rest of the length,
+   and the low 5 bits of C together with the byte after that give
+   the distance back less 1. */
+
+/* Longest run of literals. */
+#define MAX_LIT 32
+
+/* Greatest distance of a back reference. */
+#define MAX_OFF (1 << 13)
+
+/* Longest back reference. */
+#define MAX_REF (255 + 7 + 2)
+
+/* Returns the hash table index for the three bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t v = ((uint32_t) p[0] << 16) | (p[1] << 8) | p[2];
+  return (v * 2654435761u) >> 20;
+}
+
+/* Appends the literals from START to END at *OP, advancing *OP,
+   without going past OUT_END.  Returns false if they do not
+   fit. */
+static bool
+put_literals (uint8_t **op, const uint8_t *out_end,
+              const uint8_t *start, const uint8_t *end)
+{
+  while (start < end)
+    {
+      size_t run = end - start < MAX_LIT ? (size_t) (end - start) : MAX_LIT;
+      if ((size_t) (out_end - *op) < run + 1)
+        return false;
+      *(*op)++ = run - 1;
+      memcpy (*op, start, run);
+      *op += run;
+      start += run;
+    }
+  return true;
+}
+
+/* Compresses the IN_LEN bytes at IN, which must be less than
+   64 kB, into the OUT_LEN bytes at OUT, using HTAB as scratch
+   space.  Returns the size of the compressed data, or 0 if it
+   does not fit in OUT_LEN bytes. */
+size_t
+lzf_compress (const void *in, size_t in_len, void *out, size_t out_len,
+              uint16_t htab[LZF_HTAB_SIZE])
+{
+  const uint8_t *in_start = in;
+  const uint8_t *ip = in_start;
+  const uint8_t *in_end = in_start + in_len;
+  const uint8_t *anchor = ip;
+  uint8_t *op = out;
+  const uint8_t *out_end = op + out_len;
+
+  ASSERT (in_len < UINT16_MAX);
+
+  /* Table entries hold a position plus 1, so that 0 is empty. */
+  memset (htab, 0, LZF_HTAB_SIZE * sizeof *htab);
+
+  while (in_end - ip >= 3)
+    {
+      unsigned h = hash3 (ip);
+      size_t prev = htab[h];
+      htab[h] = ip - in_start + 1;
+
+      if (prev != 0)
+        {
+          const uint8_t *ref = in_start + prev - 1;
+          size_t off = ip - ref - 1;
+          if (off < MAX_OFF
+              && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2])
+            {
+              size_t max = in_end - ip < MAX_REF ? (size_t) (in_end - ip)
+                                                 : MAX_REF;
+              size_t len = 3;
+              size_t l;
+
+              while (len < max && ref[len] == ip[len])
+                len++;
+
+              if (!put_literals (&op, out_end, anchor, ip)
+                  || out_end - op < (len - 2 >= 7 ? 3 : 2))
+                return 0;
+              l = len - 2;
+              if (l < 7)
+                *op++ = (l << 5) | (off >> 8);
+              else
+                {
+                  *op++ = (7 << 5) | (off >> 8);
+                  *op++ = l - 7;
+                }
+              *op++ = off & 0xff;
+
+              ip += len;
+              anchor = ip;
+              continue;
+            }
+        }
+      ip++;
+    }
+
+  if (!put_literals (&op, out_end, anchor, in_end))
+    return 0;
+  return op - (uint8_t *) out;
+}
+
+/* Decompresses the IN_LEN bytes at IN into the OUT_LEN bytes at
+   OUT.  Returns the number of bytes produced, or 0 if the data is
+   corrupt or decompresses to more than OUT_LEN bytes. */
+size_t
+lzf_decompress (const void *in, size_t in_len, void *out, size_t out_len)
+{
+  const uint8_t *ip = in;
+  const uint8_t *in_end = ip + in_len;
+  uint8_t *out_start = out;
+  uint8_t *op = out_start;
+  const uint8_t *out_end = op + out_len;
+
+  while (ip < in_end)
+    {
+      unsigned c = *ip++;
+      if (c < MAX_LIT)
+        {
+          size_t run = c + 1;
+          if ((size_t) (in_end - ip) < run || (size_t) (out_end - op) < run)
+            return 0;
+          memcpy (op, ip, run);
+          op += run;
+          ip += run;
+        }
+      else
+        {
+          size_t len = c >> 5;
+          size_t dist;
+          const uint8_t *ref;
+
+          if (len == 7)
+            {
+              if (ip >= in_end)
+                return 0;
+              len += *ip++;
+            }
+          if (ip >= in_end)
+            return 0;
+          dist = ((c & 0x1f) << 8) + *ip++ + 1;
+          len += 2;
+          if (dist > (size_t) (op - out_start)
+              || (size_t) (out_end - op) < len)
+            return 0;
+
+          /* The reference may overlap the bytes being produced. */
+          ref = op - dist;
+          while (len-- > 0)
+            *op++ = *ref++;
+        }
+    }
+  return op - out_start;
+}
@@ -0,0 +1,24 @@
+#ifndef __LIB_KERNEL_LZF_H
+#define __LIB_KERNEL_LZF_H
+
+/* LZF-style compression.
+
+   A fast LZ77 compressor with a single hash probe per position,
+   for data of less than 64 kB such as pages.  Compressed data is
+   a sequence of literal runs of up to 32 bytes and back
+   references of 3 to 264 bytes reaching up to 8 kB back. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of entries in the hash table that lzf_compress() uses
+   as scratch space. */
+#define LZF_HTAB_SIZE 4096
+
+size_t lzf_compress (const void *in, size_t in_len,
+                     void *out, size_t out_len,
+                     uint16_t htab[LZF_HTAB_SIZE]);
+size_t lzf_decompress (const void *in, size_t in_len,
+                       void *out, size_t out_len);
+
+#endif /* lib/kernel/lzf.h */
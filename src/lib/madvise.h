@@ -0,0 +1,14 @@
+#ifndef __LIB_MADVISE_H
+#define __LIB_MADVISE_H
+
+/* Access pattern hints for the madvise system call. */
+enum
+  {
+    MADV_NORMAL,                /* No special treatment. */
+    MADV_SEQUENTIAL,            /* Expect sequential access: read ahead. */
+    MADV_RANDOM,                /* Expect random access: no read-ahead. */
+    MADV_WILLNEED,              /* Start loading the pages now. */
+    MADV_DONTNEED               /* Release the frames of clean pages. */
+  };
+
+#endif /* lib/madvise.h */
@@ -0,0 +1,16 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+/* Memory statistics of a process, as reported by the memstat
+   system call.  Page counts are in 4 kB pages. */
+struct memstat
+  {
+    unsigned minor_faults;      /* Faults resolved without I/O. */
+    unsigned major_faults;      /* Faults that read a file or swap. */
+    unsigned resident_pages;    /* Pages currently in memory. */
+    unsigned wss_pages;         /* Pages accessed in last sample period. */
+    unsigned peak_wss_pages;    /* Largest wss_pages seen. */
+    unsigned wss_samples;       /* Number of samples taken. */
+  };
+
+#endif /* lib/memstat.h */
@@ -29,7 +29,13 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Duplicate the calling process. */
+    SYS_MEMSTAT,                /* Obtain memory statistics. */
+    SYS_MADVISE,                /* Give advice about use of memory. */
+    SYS_FSYNC                   /* Write a file's data to disk. */
   };
 
 #endif /* lib/syscall-nr.h */
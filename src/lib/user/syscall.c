@@ -147,6 +147,18 @@ pipe (int *fds)
   return syscall1 (SYS_PIPE, fds);
 }
 
+pid_t
+fork (void)
+{
+  return syscall0 (SYS_FORK);
+}
+
+void
+memstat (struct memstat *ms)
+{
+  syscall1 (SYS_MEMSTAT, ms);
+}
+
 mapid_t
 mmap (int fd, void *addr)
 {
@@ -159,6 +171,12 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+int
+madvise (void *addr, size_t length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -188,3 +206,9 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
@@ -2,7 +2,10 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
+#include <madvise.h>
+#include <memstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -34,10 +37,13 @@ void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
 int pipe (int *fds);
+pid_t fork (void);
+void memstat (struct memstat *);
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+int madvise (void *addr, size_t length, int advice);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -45,5 +51,6 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+bool fsync (int fd);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($b) = random_bytes (5000);
+check_archive ({'a' => {'b' => [$b]}});
+pass;
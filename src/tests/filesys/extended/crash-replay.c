@@ -0,0 +1,30 @@
+/* Creates a directory and a file in it, writes the file and
+   syncs it.  Run with -jcrash=1, the machine powers off once the
+   sync has written these changes to the journal, before they are
+   written in place, so that they persist only if the next boot
+   replays the journal. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 5000
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (create ("a/b", 0), "create \"a/b\"");
+  CHECK ((fd = open ("a/b")) > 1, "open \"a/b\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"a/b\"");
+  msg ("fsync \"a/b\"");
+  fsync (fd);
+  fail ("fsync \"a/b\" returned instead of crashing");
+}
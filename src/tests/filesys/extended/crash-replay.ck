@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+fail "missing 'fsync' message\n"
+  if !grep ($_ eq '(crash-replay) fsync "a/b"', @output);
+fail "missing 'crashing' message--fsync didn't commit anything\n"
+  if !grep (/^journal: crashing/, @output);
+pass;
@@ -0,0 +1,59 @@
+/* Creates 1,000 files in one directory, which is enough to split
+   its index, then checks that each can be found, that readdir
+   returns each once, and that they can all be removed. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 1000
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 1];
+  int fd, cnt, i;
+
+  CHECK (mkdir ("/big"), "mkdir \"/big\"");
+  CHECK (chdir ("/big"), "chdir \"/big\"");
+
+  msg ("creating file0 through file%d...", FILE_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("opening file0 through file%d...", FILE_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+  snprintf (name, sizeof name, "file%d", FILE_CNT);
+  CHECK (open (name) == -1, "open \"%s\" (must return -1)", name);
+
+  CHECK ((fd = open (".")) > 1, "open \".\"");
+  for (cnt = 0; readdir (fd, name); cnt++)
+    continue;
+  CHECK (cnt == FILE_CNT, "readdir \".\" returned %d entries", cnt);
+  close (fd);
+
+  msg ("removing file0 through file%d...", FILE_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+
+  CHECK (chdir ("/"), "chdir \"/\"");
+  CHECK (remove ("/big"), "remove \"/big\"");
+}
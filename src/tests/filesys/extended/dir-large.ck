@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-large) begin
+(dir-large) mkdir "/big"
+(dir-large) chdir "/big"
+(dir-large) creating file0 through file999...
+(dir-large) opening file0 through file999...
+(dir-large) open "file1000" (must return -1)
+(dir-large) open "."
+(dir-large) readdir "." returned 1000 entries
+(dir-large) removing file0 through file999...
+(dir-large) chdir "/"
+(dir-large) remove "/big"
+(dir-large) end
+EOF
+pass;
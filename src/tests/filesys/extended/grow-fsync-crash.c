@@ -0,0 +1,19 @@
+/* Grows two files in parallel in small appends and syncs them
+   while they are still open.  Run with -jcrash=2, the machine
+   powers off during the second sync, so that the files have their
+   contents after the next boot only if each sync wrote them. */
+
+#include "tests/filesys/extended/grow-fsync.inc"
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+
+  grow_files (&fd_a, &fd_b);
+
+  CHECK (fsync (fd_a), "fsync \"a\"");
+  msg ("fsync \"b\"");
+  fsync (fd_b);
+  fail ("fsync \"b\" returned instead of crashing");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+fail "missing 'fsync \"a\"' message\n"
+  if !grep ($_ eq '(grow-fsync-crash) fsync "a"', @output);
+fail "missing 'fsync \"b\"' message\n"
+  if !grep ($_ eq '(grow-fsync-crash) fsync "b"', @output);
+fail "missing 'crashing' message--fsync didn't commit anything\n"
+  if !grep (/^journal: crashing/, @output);
+pass;
@@ -0,0 +1,26 @@
+/* Grows two files in parallel in small appends, syncs them while
+   they are still open, and checks that their contents are
+   correct. */
+
+#include "tests/filesys/extended/grow-fsync.inc"
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+
+  grow_files (&fd_a, &fd_b);
+
+  CHECK (fsync (fd_a), "fsync \"a\"");
+  CHECK (fsync (fd_b), "fsync \"b\"");
+  CHECK (!fsync (-1), "fsync -1 (must return false)");
+
+  check_file ("a", buf_a, FILE_SIZE);
+  check_file ("b", buf_b, FILE_SIZE);
+
+  msg ("close \"a\"");
+  close (fd_a);
+
+  msg ("close \"b\"");
+  close (fd_b);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-fsync) begin
+(grow-fsync) create "a"
+(grow-fsync) create "b"
+(grow-fsync) open "a"
+(grow-fsync) open "b"
+(grow-fsync) append to "a" and "b" alternately
+(grow-fsync) fsync "a"
+(grow-fsync) fsync "b"
+(grow-fsync) fsync -1 (must return false)
+(grow-fsync) open "a" for verification
+(grow-fsync) verified contents of "a"
+(grow-fsync) close "a"
+(grow-fsync) open "b" for verification
+(grow-fsync) verified contents of "b"
+(grow-fsync) close "b"
+(grow-fsync) close "a"
+(grow-fsync) close "b"
+(grow-fsync) end
+EOF
+pass;
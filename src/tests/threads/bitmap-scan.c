@@ -0,0 +1,109 @@
+/* Searches a 2-megabit bitmap that is nearly full, with isolated
+   free bits scattered through it and one longer free run near
+   its end, both with bitmap_scan() and with a bit-at-a-time
+   reference search.  Checks that both find the same runs and
+   that bitmap_count() agrees with a bit-at-a-time count, and
+   reports how long each search takes. */
+
+#include <bitmap.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "devices/timer.h"
+
+/* Size of the bitmap. */
+#define MAP_BITS (2 * 1024 * 1024)
+
+/* Distance between isolated free bits. */
+#define HOLE_STRIDE 997
+
+/* Length and start of the free run. */
+#define RUN_BITS 100
+#define RUN_START (MAP_BITS - 5000)
+
+/* Number of times each search is timed. */
+#define SCAN_CNT 10
+
+static size_t reference_scan (const struct bitmap *, size_t cnt, bool);
+static void check_scan (const struct bitmap *, size_t cnt);
+
+void
+test_bitmap_scan (void)
+{
+  struct bitmap *b;
+  size_t i, cnt;
+
+  b = bitmap_create (MAP_BITS);
+  if (b == NULL)
+    fail ("couldn't allocate bitmap");
+  bitmap_set_all (b, true);
+  for (i = HOLE_STRIDE; i < MAP_BITS; i += HOLE_STRIDE)
+    bitmap_reset (b, i);
+  bitmap_set_multiple (b, RUN_START, RUN_BITS, false);
+
+  cnt = 0;
+  for (i = 0; i < MAP_BITS; i++)
+    if (!bitmap_test (b, i))
+      cnt++;
+  if (bitmap_count (b, 0, MAP_BITS, false) != cnt)
+    fail ("bitmap_count() returned %zu, expected %zu",
+          bitmap_count (b, 0, MAP_BITS, false), cnt);
+  msg ("%zu free bits", cnt);
+
+  check_scan (b, 1);
+  check_scan (b, 2);
+  check_scan (b, RUN_BITS);
+  check_scan (b, RUN_BITS + 1);
+
+  bitmap_destroy (b);
+}
+
+/* Searches B for CNT free bits with bitmap_scan() and with
+   reference_scan(), checks that both agree and reports how long
+   each took. */
+static void
+check_scan (const struct bitmap *b, size_t cnt)
+{
+  int64_t start, fast_ticks, slow_ticks;
+  size_t fast_idx = 0, slow_idx = 0;
+  int i;
+
+  start = timer_ticks ();
+  for (i = 0; i < SCAN_CNT; i++)
+    fast_idx = bitmap_scan (b, 0, cnt, false);
+  fast_ticks = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (i = 0; i < SCAN_CNT; i++)
+    slow_idx = reference_scan (b, cnt, false);
+  slow_ticks = timer_elapsed (start);
+
+  if (fast_idx != slow_idx)
+    fail ("scan for %zu bits found %zu, expected %zu",
+          cnt, fast_idx, slow_idx);
+  if (fast_idx == BITMAP_ERROR)
+    msg ("no run of %zu free bits", cnt);
+  else
+    msg ("first run of %zu free bits at %zu", cnt, fast_idx);
+  msg ("%zu bits: bitmap_scan() took %"PRId64" ticks, "
+       "bit by bit took %"PRId64" ticks", cnt, fast_ticks, slow_ticks);
+}
+
+/* Returns the index of the first run of CNT bits in B set to
+   VALUE, testing one bit at a time, or BITMAP_ERROR if there is
+   none. */
+static size_t
+reference_scan (const struct bitmap *b, size_t cnt, bool value)
+{
+  size_t bit_cnt = bitmap_size (b);
+  size_t i, j;
+
+  for (i = 0; i + cnt <= bit_cnt; i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
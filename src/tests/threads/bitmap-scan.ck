@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Timings depend on the machine, so only check that each search
+# reported one.
+my (@timings) = grep (/^\(bitmap-scan\) \d+ bits: .* ticks$/, @output);
+fail "Expected 4 timings, found " . scalar (@timings) . "\n"
+  if @timings != 4;
+@output = grep (!/ ticks$/, @output);
+
+compare_output ("run", \@output, [<<'EOF2']);
+(bitmap-scan) begin
+(bitmap-scan) 2203 free bits
+(bitmap-scan) first run of 1 free bits at 997
+(bitmap-scan) first run of 2 free bits at 2092152
+(bitmap-scan) first run of 100 free bits at 2092152
+(bitmap-scan) no run of 101 free bits
+(bitmap-scan) end
+EOF2
+pass;
@@ -0,0 +1,64 @@
+/* Compresses pages with the contents typical of swapped out user
+   memory, decompresses them again and checks that the result
+   matches, and reports how well each one compressed.  Also checks
+   that a page of random bytes does not fit in the space that the
+   compressed swap allows. */
+
+#include <lzf.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+static uint16_t htab[LZF_HTAB_SIZE];
+
+static void check_page (const char *name, const uint8_t *page,
+                        uint8_t *buf, uint8_t *out);
+
+void
+test_lzf_page (void)
+{
+  uint8_t *page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  uint8_t *buf = palloc_get_multiple (PAL_ASSERT, 2);
+  uint8_t *out = palloc_get_page (PAL_ASSERT);
+  int *ints = (int *) page;
+  size_t i;
+
+  check_page ("zeros", page, buf, out);
+
+  for (i = 0; i < PGSIZE / sizeof *ints; i++)
+    ints[i] = i % 64 * (i / 64);
+  check_page ("matrix", page, buf, out);
+
+  for (i = 0; i < PGSIZE; i++)
+    page[i] = "The quick brown fox jumps over the lazy dog. "[i % 45];
+  check_page ("text", page, buf, out);
+
+  random_init (0);
+  random_bytes (page, PGSIZE);
+  check_page ("random", page, buf, out);
+  if (lzf_compress (page, PGSIZE, buf, PGSIZE * 3 / 4, htab) != 0)
+    fail ("random page compressed to 3/4 of a page");
+  msg ("random page rejected for compressed swap");
+
+  palloc_free_page (out);
+  palloc_free_multiple (buf, 2);
+  palloc_free_page (page);
+}
+
+/* Compresses PAGE into BUF, which has room for two pages,
+   decompresses it into OUT and checks that OUT matches PAGE. */
+static void
+check_page (const char *name, const uint8_t *page, uint8_t *buf, uint8_t *out)
+{
+  size_t size = lzf_compress (page, PGSIZE, buf, 2 * PGSIZE, htab);
+  if (size == 0)
+    fail ("%s page did not compress", name);
+  if (lzf_decompress (buf, size, out, PGSIZE) != PGSIZE)
+    fail ("%s page did not decompress to a page", name);
+  if (memcmp (page, out, PGSIZE))
+    fail ("%s page changed in compression", name);
+  msg ("%s page: %zu bytes", name, size);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Random data does not compress, but exactly how much it grows is
+# of no interest.
+@output = map { s/^(\(lzf-page\) random page: )\d+ bytes$/$1N bytes/; $_ }
+  @output;
+
+compare_output ("run", \@output, [<<'EOF']);
+(lzf-page) begin
+(lzf-page) zeros page: 50 bytes
+(lzf-page) matrix page: 2831 bytes
+(lzf-page) text page: 97 bytes
+(lzf-page) random page: N bytes
+(lzf-page) random page rejected for compressed swap
+(lzf-page) end
+EOF
+pass;
@@ -0,0 +1,142 @@
+/* Allocates and frees objects of a size that malloc() rounds up
+   by almost half, through an object cache and through malloc(),
+   and reports how many allocations each manages per timer tick.
+   Also checks that the cache's slots are smaller than malloc()'s
+   blocks, that its constructor runs once per slot rather than
+   once per allocation, and that its statistics add up. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "devices/timer.h"
+
+/* Objects allocated in the test. */
+struct obj
+  {
+    unsigned magic;             /* Set to OBJ_MAGIC by obj_ctor(). */
+    char data[32];              /* Filled in by the test. */
+  };
+
+#define OBJ_MAGIC 0x0b1ec7ed
+
+/* Objects live at once. */
+#define OBJ_CNT 256
+
+/* Length of each measurement, in timer ticks. */
+#define BENCH_TICKS 10
+
+static struct slab_cache cache;
+static void *objs[OBJ_CNT];
+static int ctor_cnt;
+
+static void obj_ctor (void *);
+static void *cache_alloc (size_t);
+static bool fill_and_free (void *(*alloc) (size_t), void (*release) (void *));
+static int64_t measure (void *(*alloc) (size_t), void (*release) (void *));
+
+void
+test_slab_alloc (void)
+{
+  int constructed;
+
+  slab_cache_init (&cache, "slab-alloc", sizeof (struct obj), obj_ctor);
+  if (cache.slot_size >= 64)
+    fail ("%zu-byte slots for %zu-byte objects",
+          cache.slot_size, sizeof (struct obj));
+  msg ("slots are smaller than malloc() blocks");
+
+  if (!fill_and_free (cache_alloc, slab_free))
+    fail ("object not constructed");
+  constructed = ctor_cnt;
+  if ((size_t) constructed != cache.slab_cnt * cache.slots_per_slab)
+    fail ("constructor ran %d times for %zu slots",
+          constructed, cache.slab_cnt * cache.slots_per_slab);
+  msg ("constructor ran once per slot");
+
+  if (!fill_and_free (cache_alloc, slab_free))
+    fail ("reused object lost its constructed state");
+  if (ctor_cnt != constructed)
+    fail ("constructor ran again for reused objects");
+  msg ("reused objects kept their constructed state");
+
+  if (cache.in_use != 0 || cache.peak_in_use != OBJ_CNT
+      || cache.alloc_cnt != 2 * OBJ_CNT || cache.free_cnt != 2 * OBJ_CNT)
+    fail ("bad statistics: %zu in use, peak %zu, %"PRIu64" allocs, "
+          "%"PRIu64" frees", cache.in_use, cache.peak_in_use,
+          cache.alloc_cnt, cache.free_cnt);
+  msg ("statistics add up");
+
+  msg ("slab_alloc(): %"PRId64" allocations per tick",
+       measure (cache_alloc, slab_free));
+  msg ("malloc(): %"PRId64" allocations per tick",
+       measure (malloc, free));
+
+  slab_cache_destroy (&cache);
+}
+
+static void
+obj_ctor (void *p)
+{
+  struct obj *o = p;
+  o->magic = OBJ_MAGIC;
+  ctor_cnt++;
+}
+
+static void *
+cache_alloc (size_t size UNUSED)
+{
+  return slab_alloc (&cache);
+}
+
+/* Allocates OBJ_CNT objects with ALLOC, checking that each was
+   constructed, then frees them with RELEASE.  Returns false if
+   an object was not constructed. */
+static bool
+fill_and_free (void *(*alloc) (size_t), void (*release) (void *))
+{
+  bool ok = true;
+  int i;
+
+  for (i = 0; i < OBJ_CNT; i++)
+    {
+      struct obj *o = objs[i] = alloc (sizeof *o);
+      if (o == NULL)
+        fail ("out of memory after %d objects", i);
+      if (o->magic != OBJ_MAGIC)
+        ok = false;
+      memset (o->data, i, sizeof o->data);
+    }
+  for (i = 0; i < OBJ_CNT; i++)
+    release (objs[i]);
+  return ok;
+}
+
+/* Returns the number of objects allocated per timer tick, when
+   OBJ_CNT objects at a time are allocated with ALLOC and freed
+   with RELEASE. */
+static int64_t
+measure (void *(*alloc) (size_t), void (*release) (void *))
+{
+  int64_t start, cnt = 0;
+  int i;
+
+  /* Start at the beginning of a tick. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+
+  start = timer_ticks ();
+  while (timer_elapsed (start) < BENCH_TICKS)
+    {
+      for (i = 0; i < OBJ_CNT; i++)
+        if ((objs[i] = alloc (sizeof (struct obj))) == NULL)
+          fail ("out of memory");
+      for (i = 0; i < OBJ_CNT; i++)
+        release (objs[i]);
+      cnt += OBJ_CNT;
+    }
+  return cnt / BENCH_TICKS;
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Allocation rates depend on the machine, so only check that both
+# were reported.
+my (@rates) = grep (/^\(slab-alloc\) .*: \d+ allocations per tick$/, @output);
+fail "Expected 2 allocation rates, found " . scalar (@rates) . "\n"
+  if @rates != 2;
+@output = grep (!/ allocations per tick$/, @output);
+
+compare_output ("run", \@output, [<<'EOF2']);
+(slab-alloc) begin
+(slab-alloc) slots are smaller than malloc() blocks
+(slab-alloc) constructor ran once per slot
+(slab-alloc) reused objects kept their constructed state
+(slab-alloc) statistics add up
+(slab-alloc) end
+EOF2
+pass;
@@ -49,6 +49,9 @@ static const struct test tests[] =
     {"seqlock3", test_seqlock3},
     {"seqlock4", test_seqlock4},
     {"seqlock5", test_seqlock5},
+    {"slab-alloc", test_slab_alloc},
+    {"bitmap-scan", test_bitmap_scan},
+    {"lzf-page", test_lzf_page},
   };
 
 static const char *test_name;
@@ -45,6 +45,9 @@ extern test_func test_seqlock2;
 extern test_func test_seqlock3;
 extern test_func test_seqlock4;
 extern test_func test_seqlock5;
+extern test_func test_slab_alloc;
+extern test_func test_bitmap_scan;
+extern test_func test_lzf_page;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,8 @@
+/* Child process of exec-loop.
+   Exits immediately, so that only process creation is measured. */
+
+int
+main (void) 
+{
+  return 0x42;
+}
@@ -0,0 +1,24 @@
+/* Executes and waits for CHILD_CNT children that exit right away.
+   Baseline for fork-loop. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 32
+
+void
+test_main (void)
+{
+  int i;
+
+  quiet = true;
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      pid_t child;
+      CHECK ((child = exec ("child-exit")) != -1, "exec child %d", i);
+      CHECK (wait (child) == 0x42, "wait for child %d", i);
+    }
+  quiet = false;
+  msg ("executed %d children", CHILD_CNT);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(exec-loop) begin
+(exec-loop) executed 32 children
+(exec-loop) end
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Forks a child that overwrites pages of the data segment, the
+   BSS and the stack that it shares copy-on-write with its parent,
+   and checks that each process only sees its own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (3 * 4096)
+
+static char data[SIZE] = {'d'};
+static char bss[SIZE];
+
+/* Returns true if all SIZE bytes of BUF equal C. */
+static bool
+all_equal (const char *buf, char c) 
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  char stack[SIZE];
+  pid_t child;
+
+  memset (data, 'p', SIZE);
+  memset (bss, 'p', SIZE);
+  memset (stack, 'p', SIZE);
+
+  child = fork ();
+  if (child == 0)
+    {
+      /* Child: must not print, its output would interleave. */
+      memset (data, 'c', SIZE);
+      memset (bss, 'c', SIZE);
+      memset (stack, 'c', SIZE);
+      exit (all_equal (data, 'c') && all_equal (bss, 'c')
+            && all_equal (stack, 'c') ? 0x42 : 1);
+    }
+
+  CHECK (child > 0, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+  CHECK (all_equal (data, 'p'), "parent's data unchanged");
+  CHECK (all_equal (bss, 'p'), "parent's bss unchanged");
+  CHECK (all_equal (stack, 'p'), "parent's stack unchanged");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) fork
+(fork-cow) wait for child
+(fork-cow) parent's data unchanged
+(fork-cow) parent's bss unchanged
+(fork-cow) parent's stack unchanged
+(fork-cow) end
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Forks and waits for CHILD_CNT children that exit right away.
+   Run alongside exec-loop, which creates the same number of
+   processes with exec: the timer ticks reported at shutdown show
+   the cost of fork against exec. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 32
+
+void
+test_main (void)
+{
+  int i;
+
+  quiet = true;
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      pid_t child = fork ();
+      if (child == 0)
+        exit (i);
+      CHECK (child > 0, "fork child %d", i);
+      CHECK (wait (child) == i, "wait for child %d", i);
+    }
+  quiet = false;
+  msg ("forked %d children", CHILD_CNT);
+}
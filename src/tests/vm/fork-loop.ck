@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-loop) begin
+(fork-loop) forked 32 children
+(fork-loop) end
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Gives each kind of advice for a mapped file and checks that
+   MADV_DONTNEED gives up the clean page, that the data survives
+   it, and that bad ranges are rejected. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  struct memstat before, after;
+  int handle;
+  mapid_t map;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (madvise (actual, 4096, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  memstat (&before);
+  CHECK (madvise (actual, 4096, MADV_DONTNEED) == 0, "madvise dontneed");
+  memstat (&after);
+  CHECK (after.resident_pages == before.resident_pages - 1,
+         "clean page released");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read after MADV_DONTNEED reported bad data");
+
+  CHECK (madvise (actual, 4096, MADV_WILLNEED) == 0, "madvise willneed");
+  CHECK (madvise (actual, 4096, MADV_RANDOM) == 0, "madvise random");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read after MADV_WILLNEED reported bad data");
+
+  CHECK (madvise (actual + 1, 4096, MADV_NORMAL) == -1,
+         "madvise misaligned address");
+  CHECK (madvise (actual, 8192, MADV_NORMAL) == -1,
+         "madvise unmapped page");
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) madvise sequential
+(madvise) madvise dontneed
+(madvise) clean page released
+(madvise) madvise willneed
+(madvise) madvise random
+(madvise) madvise misaligned address
+(madvise) madvise unmapped page
+(madvise) end
+EOF
+pass;
@@ -0,0 +1,57 @@
+/* Touches every page of an array in the BSS and of a file
+   mapping, and checks that memstat() counts the faults as minor
+   and major respectively and reports the pages as resident.
+   Then keeps touching the array for a whole working set sample
+   period, and checks that its pages are in the working set. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 16
+
+/* Page aligned, so that no page holds initialized data. */
+static char buf[PAGE_CNT * 4096] __attribute__ ((aligned (4096)));
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  char *actual = (char *) 0x10000000;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  memstat (&before);
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * 4096] = 1;
+  memstat (&after);
+  CHECK (after.minor_faults - before.minor_faults >= PAGE_CNT,
+         "minor faults for zeroed pages");
+  CHECK (after.resident_pages - before.resident_pages >= PAGE_CNT,
+         "zeroed pages resident");
+
+  /* A period that starts after BEFORE has ended once two more
+     samples are counted. */
+  memstat (&before);
+  do
+    {
+      for (i = 0; i < PAGE_CNT; i++)
+        buf[i * 4096]++;
+      memstat (&after);
+    }
+  while (after.wss_samples - before.wss_samples < 2);
+  CHECK (after.wss_pages >= PAGE_CNT, "touched pages in working set");
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memstat (&before);
+  if (*(volatile char *) actual == 0)
+    fail ("mapped file reads as zero");
+  memstat (&after);
+  CHECK (after.major_faults - before.major_faults >= 1,
+         "major fault for file page");
+
+  munmap (map);
+  close (handle);
+}
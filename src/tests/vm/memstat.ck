@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(memstat) begin
+(memstat) minor faults for zeroed pages
+(memstat) zeroed pages resident
+(memstat) touched pages in working set
+(memstat) open "sample.txt"
+(memstat) mmap "sample.txt"
+(memstat) major fault for file page
+(memstat) end
+EOF
+pass;
@@ -0,0 +1,12 @@
+/* Checks that the writeback thread writes a dirty mapped page
+   back within the interval given by -wbinterval, which is run
+   with a dirty ratio too high to start a writeback early. */
+
+#include "tests/vm/writeback.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  check_writeback ();
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-wb-interval) begin
+(mmap-wb-interval) create "sample.txt"
+(mmap-wb-interval) open "sample.txt"
+(mmap-wb-interval) open "sample.txt" again
+(mmap-wb-interval) mmap "sample.txt"
+(mmap-wb-interval) mapped data written back before munmap
+(mmap-wb-interval) end
+EOF
+pass;
@@ -0,0 +1,12 @@
+/* Checks that the writeback thread writes a dirty mapped page
+   back early once the dirty ratio given by -wbratio is passed,
+   which is run with an interval far longer than the test. */
+
+#include "tests/vm/writeback.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  check_writeback ();
+}
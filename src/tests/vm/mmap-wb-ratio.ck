@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-wb-ratio) begin
+(mmap-wb-ratio) create "sample.txt"
+(mmap-wb-ratio) open "sample.txt"
+(mmap-wb-ratio) open "sample.txt" again
+(mmap-wb-ratio) mmap "sample.txt"
+(mmap-wb-ratio) mapped data written back before munmap
+(mmap-wb-ratio) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Writes to a file through a mapping and, without unmapping it,
+   reads the file with the read system call until the writeback
+   thread has written the data back.  Fails if that takes more
+   than a few working set sample periods, that is, seconds. */
+
+#include "tests/vm/writeback.h"
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+/* Sample periods to wait for the writeback. */
+#define MAX_SAMPLES 3
+
+void
+check_writeback (void)
+{
+  struct memstat before, now;
+  int handle, reader;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((reader = open ("sample.txt")) > 1, "open \"sample.txt\" again");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+
+  memstat (&before);
+  for (;;)
+    {
+      seek (reader, 0);
+      if (read (reader, buf, strlen (sample)) == (int) strlen (sample)
+          && !memcmp (buf, sample, strlen (sample)))
+        break;
+      memstat (&now);
+      if (now.wss_samples - before.wss_samples >= MAX_SAMPLES)
+        fail ("mapped data not written back in the background");
+    }
+  msg ("mapped data written back before munmap");
+
+  munmap (map);
+  close (reader);
+  close (handle);
+}
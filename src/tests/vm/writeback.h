@@ -0,0 +1,6 @@
+#ifndef TESTS_VM_WRITEBACK
+#define TESTS_VM_WRITEBACK 1
+
+void check_writeback (void);
+
+#endif /* tests/vm/writeback.h */
@@ -21,6 +21,7 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -34,8 +35,17 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/prefetch.h"
+#include "vm/swap.h"
+#include "vm/writeback.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -57,6 +67,17 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef VM
+/* -zswap: Maximum number of kernel pages holding compressed swap. */
+static size_t zswap_page_limit = 64;
+
+/* -wbinterval, -wbratio: Milliseconds between writebacks of dirty
+   mapped pages, and percentage of frames that may be dirty before
+   writeback starts early. */
+static unsigned writeback_interval = 1000;
+static unsigned writeback_ratio = 10;
+#endif
+
 static void bss_init (void);
 static void paging_init (void);
 
@@ -97,6 +118,7 @@ main (void)
   /* Initialize memory system. */
   palloc_init (user_page_limit);
   malloc_init ();
+  slab_init ();
   paging_init ();
 
   /* Segmentation. */
@@ -127,6 +149,16 @@ main (void)
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize virtual memory. */
+  vm_entry_cache_init ();
+  frame_table_init ();
+  vm_wss_init ();
+  swap_init (zswap_page_limit);
+  prefetch_init ();
+  writeback_init (writeback_interval, writeback_ratio);
+#endif
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -150,16 +182,43 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Flags in control register 4. */
+#define CR4_PSE 0x00000010      /* Page Size Extensions. */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
+
+/* Feature flags in EDX returned by CPUID function 1. */
+#define CPUID_PSE (1 << 3)      /* 4 MB pages. */
+#define CPUID_PGE (1 << 13)     /* Global pages. */
+
+/* Returns the feature flags that CPUID function 1 reports in
+   EDX.  See [IA32-v2a] "CPUID". */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   Each 4 MB of RAM is mapped with a single 4 MB page, if the CPU
+   supports them, so that it needs no page table and takes a
+   single TLB entry.  The 4 MB that hold the kernel's code, and
+   any partial 4 MB at the end of RAM, still use 4 kB pages, so
+   that code stays read-only and nothing beyond RAM is mapped. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpu_features ();
+  bool use_pse = (features & CPUID_PSE) != 0;
+  uint32_t cr4;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -171,6 +230,15 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (use_pse && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true);
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -180,12 +248,25 @@ paging_init (void)
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
     }
 
+  /* Allow 4 MB pages before they come into use. */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (use_pse)
+    cr4 |= CR4_PSE;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Keep kernel mappings, which are global, in the TLB across
+     later CR3 loads.  Turned on only now, so that no global
+     entry from the loader's page tables survives.  See
+     [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)". */
+  if (features & CPUID_PGE)
+    asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE));
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -247,6 +328,10 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-jcrash"))
+        journal_crash = atoi (value);
+      else if (!strcmp (name, "-flush"))
+        cache_flush_secs = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -261,6 +346,16 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-vmstats"))
+        vm_report_stats = true;
+      else if (!strcmp (name, "-zswap"))
+        zswap_page_limit = atoi (value);
+      else if (!strcmp (name, "-wbinterval"))
+        writeback_interval = atoi (value);
+      else if (!strcmp (name, "-wbratio"))
+        writeback_ratio = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -375,6 +470,8 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -jcrash=N          Power off once the Nth fsync has been journaled.\n"
+          "  -flush=SECS        Write cached data to disk every SECS seconds.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -383,6 +480,12 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -vmstats           Print memory statistics of processes at exit.\n"
+          "  -zswap=COUNT       Keep up to COUNT pages of compressed swap in RAM.\n"
+          "  -wbinterval=MS     Write back dirty mapped pages every MS ms.\n"
+          "  -wbratio=PERCENT   Write back early above PERCENT dirty frames.\n"
 #endif
           );
   shutdown_power_off ();
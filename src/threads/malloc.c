@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -32,7 +33,10 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Objects obtained from an object cache (see slab.c) may also be
+   passed to free(), which hands them back to their cache. */
 
 /* Descriptor. */
 struct desc
@@ -215,11 +219,13 @@ realloc (void *old_block, size_t new_size)
 }
 
 /* Frees block P, which must have been previously allocated with
-   malloc(), calloc(), or realloc(). */
+   malloc(), calloc(), realloc(), or slab_alloc(). */
 void
 free (void *p) 
 {
-  if (p != NULL)
+  if (p != NULL && slab_owns (p))
+    slab_free (p);
+  else if (p != NULL)
     {
       struct block *b = p;
       struct arena *a = block_to_arena (b);
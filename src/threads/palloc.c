@@ -1,14 +1,14 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,14 +23,70 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Free memory is kept as
+   blocks of 2**ORDER pages, aligned to their size relative to the
+   pool base, on one free list per order.  A request is rounded up
+   to a power of 2, served from the smallest nonempty list, and a
+   larger block is split in halves ("buddies") on the way down.
+   Pages beyond the request are freed right away, so any page
+   count may be allocated and freed.  A freed block is merged
+   with its buddy for as long as the buddy is free as a whole, so
+   that contiguous multi-page runs reform instead of fragmenting.
+   A single page thus takes one list pop, and any request touches
+   at most MAX_ORDER lists.  A multi-page request that no free
+   block can serve, because it is larger than 2**MAX_ORDER pages
+   or than any free block, falls back to scanning the pool for a
+   run of adjacent free blocks, as the old bitmap allocator did.
+
+   Every operation is short, so a pool is protected by turning
+   interrupts off instead of by a lock.  This also lets
+   thread_schedule_tail() free a dying thread's page.  The scan is
+   not short, so it lets interrupts in every SCAN_SLICE steps, and
+   starts its current run over if the pool changed meanwhile.
+
+   While no thread is ready to run, the idle thread calls
+   palloc_zero_idle() to take free pages, clear them, and set
+   them aside on a per-pool list of pre-zeroed pages.  A
+   single-page PAL_ZERO allocation is then a list pop.  The list
+   is bounded, and when a pool runs dry its pre-zeroed pages go
+   back to the buddy lists, so they are never lost to ordinary
+   allocations. */
+
+/* Largest block handed out or merged, as a power of 2 number of
+   pages. */
+#define MAX_ORDER 10
+
+/* Most pre-zeroed pages kept by a pool. */
+#define ZEROED_MAX 64
+
+/* Steps of alloc_run()'s scan between two chances for pending
+   interrupts. */
+#define SCAN_SLICE 64
+
+/* In a pool's order map, marks the first page of a free block,
+   whose order is in the low bits. */
+#define ORDER_FREE 0x80
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *order_map;                 /* One byte per page, see above. */
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    struct list zeroed_list;            /* Pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pre-zeroed pages. */
+    size_t zeroed_max;                  /* Most pre-zeroed pages to keep. */
+    unsigned changes;                   /* Blocks allocated or freed. */
+  };
+
+/* A free block, or a pre-zeroed page.  Kept in the block's first
+   page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free list. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +95,13 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_block (struct pool *, unsigned order);
+static size_t alloc_run (struct pool *, size_t page_cnt,
+                         enum intr_level);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void *take_zeroed (struct pool *);
+static bool release_zeroed (struct pool *);
+static bool zero_page (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -66,22 +129,56 @@ palloc_init (size_t user_page_limit)
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.  Up to 2**MAX_ORDER
+   pages come from the buddy free lists; larger requests, and
+   those that no single free block can serve, scan the whole pool,
+   so they are slower. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
+  unsigned order;
+  enum intr_level old_level;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pages = take_zeroed (pool);
+      if (pages != NULL)
+        return pages;
+    }
+
+  /* Round up to a block size. */
+  for (order = 0; order <= MAX_ORDER; order++)
+    if ((size_t) 1 << order >= page_cnt)
+      break;
 
-  if (page_idx != BITMAP_ERROR)
+  page_idx = SIZE_MAX;
+  old_level = intr_disable ();
+  if (order <= MAX_ORDER)
+    {
+      page_idx = alloc_block (pool, order);
+      if (page_idx == SIZE_MAX && release_zeroed (pool))
+        page_idx = alloc_block (pool, order);
+      if (page_idx != SIZE_MAX)
+        {
+          /* Give back the part of the block we don't need. */
+          free_range (pool, page_idx + page_cnt,
+                      ((size_t) 1 << order) - page_cnt);
+        }
+    }
+  if (page_idx == SIZE_MAX && page_cnt > 1)
+    {
+      release_zeroed (pool);
+      page_idx = alloc_run (pool, page_cnt, old_level);
+    }
+  intr_set_level (old_level);
+
+  if (page_idx != SIZE_MAX)
     pages = pool->base + PGSIZE * page_idx;
   else
     pages = NULL;
@@ -119,6 +216,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -132,13 +230,15 @@ palloc_free_multiple (void *pages, size_t page_cnt)
     NOT_REACHED ();
 
   page_idx = pg_no (pages) - pg_no (pool->base);
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  free_range (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +248,45 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page and sets it aside for PAL_ZERO
+   allocations.  Called by the idle thread while no other thread
+   is ready to run.  Returns false if no pool needs more
+   pre-zeroed pages. */
+bool
+palloc_zero_idle (void)
+{
+  return zero_page (&kernel_pool) || zero_page (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  unsigned order;
+
+  /* We'll put the pool's order_map at its base.
+     Calculate the space needed for the map
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t map_pages = DIV_ROUND_UP (page_cnt, PGSIZE);
+  if (map_pages > page_cnt)
+    PANIC ("Not enough memory in %s for order map.", name);
+  page_cnt -= map_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  /* Initialize the pool, with every page free. */
+  p->order_map = base;
+  memset (p->order_map, 0, page_cnt);
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
+  p->base = base + map_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  list_init (&p->zeroed_list);
+  p->zeroed_cnt = 0;
+  p->zeroed_max = page_cnt / 8 < ZEROED_MAX ? page_cnt / 8 : ZEROED_MAX;
+  p->changes = 0;
+  free_range (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +296,224 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free block starting at page PAGE_IDX of POOL. */
+static struct free_block *
+idx_to_block (struct pool *pool, size_t page_idx)
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX to POOL's free
+   lists. */
+static void
+push_block (struct pool *pool, size_t page_idx, unsigned order)
+{
+  pool->order_map[page_idx] = ORDER_FREE | order;
+  list_push_front (&pool->free_lists[order],
+                   &idx_to_block (pool, page_idx)->elem);
+}
+
+/* Removes a free block of at least 2**ORDER pages from POOL,
+   splitting it down to that size, and returns the index of its
+   first page.  Returns SIZE_MAX if there is no such block.
+   Interrupts must be off. */
+static size_t
+alloc_block (struct pool *pool, unsigned order)
+{
+  struct free_block *b;
+  size_t page_idx;
+  unsigned o;
+
+  for (o = order; o <= MAX_ORDER; o++)
+    if (!list_empty (&pool->free_lists[o]))
+      break;
+  if (o > MAX_ORDER)
+    return SIZE_MAX;
+
+  b = list_entry (list_pop_front (&pool->free_lists[o]),
+                  struct free_block, elem);
+  page_idx = pg_no (b) - pg_no (pool->base);
+  ASSERT (pool->order_map[page_idx] == (ORDER_FREE | o));
+  pool->order_map[page_idx] = 0;
+  pool->changes++;
+
+  /* Split, keeping the lower half each time. */
+  while (o > order)
+    {
+      o--;
+      push_block (pool, page_idx + ((size_t) 1 << o), o);
+    }
+  return page_idx;
+}
+
+/* Removes the first run of PAGE_CNT free pages from POOL, made
+   of adjacent free blocks, and returns the index of its first
+   page.  Returns SIZE_MAX if there is no such run.  Walks the
+   order map from block to block, since only the first page of a
+   free block is marked in it.
+   Interrupts must be off.  They are set to OLD_LEVEL for a moment
+   every SCAN_SLICE steps. */
+static size_t
+alloc_run (struct pool *pool, size_t page_cnt, enum intr_level old_level)
+{
+  size_t start = 0, end = 0;
+  size_t page_idx;
+  unsigned steps = 0;
+
+  /* Grow [START, END) one free block at a time, restarting past
+     each allocated page. */
+  while (end - start < page_cnt)
+    {
+      uint8_t mark;
+
+      if (++steps % SCAN_SLICE == 0)
+        {
+          unsigned changes = pool->changes;
+
+          intr_set_level (old_level);
+          intr_disable ();
+          if (pool->changes != changes)
+            end = start;
+        }
+      if (end >= pool->page_cnt)
+        return SIZE_MAX;
+      mark = pool->order_map[end];
+      if (mark & ORDER_FREE)
+        end += (size_t) 1 << (mark & ~ORDER_FREE);
+      else
+        start = end = end + 1;
+    }
+
+  pool->changes++;
+  for (page_idx = start; page_idx < end; )
+    {
+      unsigned order = pool->order_map[page_idx] & ~ORDER_FREE;
+
+      pool->order_map[page_idx] = 0;
+      list_remove (&idx_to_block (pool, page_idx)->elem);
+      page_idx += (size_t) 1 << order;
+    }
+
+  /* Give back the end of the last block. */
+  free_range (pool, start + page_cnt, end - start - page_cnt);
+  return start;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy as long as the buddy is free.
+   Interrupts must be off. */
+static void
+free_block (struct pool *pool, size_t page_idx, unsigned order)
+{
+  ASSERT (!(pool->order_map[page_idx] & ORDER_FREE));
+
+  pool->changes++;
+  while (order < MAX_ORDER)
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+      if (buddy_idx >= pool->page_cnt
+          || pool->order_map[buddy_idx] != (ORDER_FREE | order))
+        break;
+
+      pool->order_map[buddy_idx] = 0;
+      list_remove (&idx_to_block (pool, buddy_idx)->elem);
+      page_idx &= ~((size_t) 1 << order);
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   largest aligned blocks that cover them.
+   Interrupts must be off, except during initialization. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      unsigned order = 0;
+      while (order < MAX_ORDER
+             && page_idx % ((size_t) 2 << order) == 0
+             && (size_t) 2 << order <= page_cnt)
+        order++;
+
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Removes a pre-zeroed page from POOL and returns it, or returns
+   a null pointer if there is none. */
+static void *
+take_zeroed (struct pool *pool)
+{
+  struct free_block *b = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (!list_empty (&pool->zeroed_list))
+    {
+      b = list_entry (list_pop_front (&pool->zeroed_list),
+                      struct free_block, elem);
+      pool->zeroed_cnt--;
+    }
+  intr_set_level (old_level);
+
+  /* Clear the list element, the only part that isn't zero. */
+  if (b != NULL)
+    memset (b, 0, sizeof *b);
+  return b;
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free lists.
+   Returns false if there were none.
+   Interrupts must be off. */
+static bool
+release_zeroed (struct pool *pool)
+{
+  if (list_empty (&pool->zeroed_list))
+    return false;
+
+  while (!list_empty (&pool->zeroed_list))
+    {
+      struct free_block *b = list_entry (list_pop_front (&pool->zeroed_list),
+                                         struct free_block, elem);
+      free_block (pool, pg_no (b) - pg_no (pool->base), 0);
+    }
+  pool->zeroed_cnt = 0;
+  return true;
+}
+
+/* Moves one page of POOL from its free lists to its pre-zeroed
+   list, zeroing it.  Returns false if POOL already has enough
+   pre-zeroed pages or has no free page.  Interrupts are kept off
+   while the page is cleared, so that it is never missing from
+   both lists. */
+static bool
+zero_page (struct pool *pool)
+{
+  enum intr_level old_level;
+  bool zeroed = false;
+
+  old_level = intr_disable ();
+  if (pool->zeroed_cnt < pool->zeroed_max)
+    {
+      size_t page_idx = alloc_block (pool, 0);
+      if (page_idx != SIZE_MAX)
+        {
+          struct free_block *b = idx_to_block (pool, page_idx);
+          memset (b, 0, PGSIZE);
+          list_push_front (&pool->zeroed_list, &b->elem);
+          pool->zeroed_cnt++;
+          zeroed = true;
+        }
+    }
+  intr_set_level (old_level);
+  return zeroed;
+}
@@ -1,12 +1,35 @@
 #include "pipe.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include <string.h>
 #include <stdio.h>
 #include "threads/thread.h"
 
+/* Cache of pipe structs. The ring buffer is a page of its own, since
+ * malloc() would need two pages for PIPE_CAP bytes plus its header */
+static struct slab_cache pipe_cache;
+
+/*Initialize the pipe cache */
+void pipe_cache_init(void) {
+  slab_cache_init(&pipe_cache, "pipe", sizeof(struct pipe), NULL);
+}
+
+/*Allocate and initialize a pipe, returns NULL if out of memory */
+struct pipe* pipe_create(void) {
+  struct pipe* pipe = slab_alloc(&pipe_cache);
+  if (pipe == NULL) return NULL;
+  pipe_init(pipe);
+  if (pipe->buffer == NULL) {
+    slab_free(pipe);
+    return NULL;
+  }
+  return pipe;
+}
+
 /*Initialize pipe struct */
 void pipe_init(struct pipe* pipe) {
-  pipe->buffer = malloc(PIPE_CAP);
+  pipe->buffer = palloc_get_page(0);
   pipe->size = 0;
   pipe->num_readers = 1;
   pipe->num_writers = 1;
@@ -80,13 +103,27 @@ int pipe_write(struct pipe* pipe, const void* buffer, unsigned size) {
   return bytes_written;
 }
 
+/*Adds a reader to pipe, for a descriptor copied by fork*/
+void pipe_add_reader(struct pipe* pipe) {
+  sema_down(&pipe->modify_sema);
+  ++pipe->num_readers;
+  sema_up(&pipe->modify_sema);
+}
+
+/*Adds a writer to pipe, for a descriptor copied by fork*/
+void pipe_add_writer(struct pipe* pipe) {
+  sema_down(&pipe->modify_sema);
+  ++pipe->num_writers;
+  sema_up(&pipe->modify_sema);
+}
+
 /*Close pipe readers and free memory*/
 void pipe_close_reader(struct pipe* pipe) {
   sema_down(&pipe->modify_sema);
   --pipe->num_readers;
   if (pipe->num_readers == 0 && pipe->num_writers == 0) {
-    free(pipe->buffer);
-    free(pipe);
+    palloc_free_page(pipe->buffer);
+    slab_free(pipe);
   } else {
     sema_up(&pipe->modify_sema);
     if (pipe->num_readers == 0) {
@@ -100,8 +137,8 @@ void pipe_close_writer(struct pipe* pipe) {
   sema_down(&pipe->modify_sema);
   --pipe->num_writers;
   if (pipe->num_readers == 0 && pipe->num_writers == 0) {
-    free(pipe->buffer);
-    free(pipe);
+    palloc_free_page(pipe->buffer);
+    slab_free(pipe);
   } else {
     sema_up(&pipe->modify_sema);
     if (pipe->num_writers == 0) {
@@ -16,8 +16,12 @@ void* buffer;
   bool write_waiting;
 };
 
+void pipe_cache_init(void);
+struct pipe* pipe_create(void);
 void pipe_init(struct pipe*);
 int pipe_read(struct pipe*, void*, unsigned);
 int pipe_write(struct pipe*, const void*, unsigned);
+void pipe_add_reader(struct pipe*);
+void pipe_add_writer(struct pipe*);
 void pipe_close_reader(struct pipe*);
 void pipe_close_writer(struct pipe*);
\ No newline at end of file
@@ -0,0 +1,304 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* An object cache allocator, layered beside malloc().
+
+   malloc() rounds every request up to a power of 2, so objects a
+   little larger than a power of 2 waste almost half of their
+   block.  A kernel object that is allocated and freed often
+   gets its own cache instead, whose slots are exactly the size
+   of the object rounded up to pointer alignment.
+
+   A cache obtains memory a page at a time from the page
+   allocator.  Each page, called a "slab", starts with a small
+   header and is divided into as many slots as fit.  The free
+   slots of all of a cache's slabs are kept on one free list, so
+   allocation and freeing are a list push or pop.
+
+   A cache may have a constructor.  It is run on each slot once,
+   when the slab is created, and objects must be returned to the
+   cache in their constructed state, so that a reused object
+   needs no further setup.  The free list link of such a cache
+   sits after the object instead of overlapping it.
+
+   A slab whose slots are all free is given back to the page
+   allocator, unless it is the cache's only spare slab, which
+   avoids churning pages when one object is repeatedly allocated
+   and freed.
+
+   Since a slab header is found by rounding an object's address
+   down to its page, free() recognizes slab objects as well and
+   passes them here. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab0b1e
+
+/* Alignment of slots. */
+#define SLAB_ALIGN sizeof (void *)
+
+/* Slab header. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    size_t free_cnt;            /* Free slots in this slab. */
+  };
+
+/* Offset of the first slot in a slab. */
+#define SLAB_HDR_SIZE ROUND_UP (sizeof (struct slab), SLAB_ALIGN)
+
+/* All caches, for statistics. */
+static struct list all_caches;
+static struct lock all_caches_lock;
+
+static struct slab *obj_to_slab (const void *);
+static void *slab_to_obj (struct slab *, size_t idx);
+static struct list_elem *obj_to_link (struct slab_cache *, void *);
+static void *link_to_obj (struct slab_cache *, struct list_elem *);
+
+/* Initializes the object cache allocator. */
+void
+slab_init (void)
+{
+  list_init (&all_caches);
+  lock_init (&all_caches_lock);
+}
+
+/* Initializes CACHE to hand out SIZE-byte objects and registers
+   it under NAME.  If CTOR is nonnull, it is called on every
+   object once, when the slab holding it is created. */
+void
+slab_cache_init (struct slab_cache *cache, const char *name, size_t size,
+                 void (*ctor) (void *))
+{
+  ASSERT (cache != NULL);
+  ASSERT (size > 0);
+
+  cache->name = name;
+  cache->obj_size = size;
+  cache->ctor = ctor;
+  if (ctor != NULL)
+    {
+      cache->link_ofs = ROUND_UP (size, SLAB_ALIGN);
+      cache->slot_size = cache->link_ofs + sizeof (struct list_elem);
+    }
+  else
+    {
+      cache->link_ofs = 0;
+      cache->slot_size = ROUND_UP (size, SLAB_ALIGN);
+      if (cache->slot_size < sizeof (struct list_elem))
+        cache->slot_size = sizeof (struct list_elem);
+    }
+  cache->slots_per_slab = (PGSIZE - SLAB_HDR_SIZE) / cache->slot_size;
+  ASSERT (cache->slots_per_slab > 0);
+  list_init (&cache->free_list);
+  lock_init (&cache->lock);
+
+  cache->slab_cnt = 0;
+  cache->free_slots = 0;
+  cache->in_use = 0;
+  cache->peak_in_use = 0;
+  cache->alloc_cnt = 0;
+  cache->free_cnt = 0;
+
+  lock_acquire (&all_caches_lock);
+  list_push_back (&all_caches, &cache->elem);
+  lock_release (&all_caches_lock);
+}
+
+/* Adds a new slab to CACHE, whose lock must be held.
+   Returns false if no page is available. */
+static bool
+grow_cache (struct slab_cache *cache)
+{
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return false;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->free_cnt = cache->slots_per_slab;
+  for (i = 0; i < cache->slots_per_slab; i++)
+    {
+      void *obj = slab_to_obj (s, i);
+      if (cache->ctor != NULL)
+        cache->ctor (obj);
+      list_push_back (&cache->free_list, obj_to_link (cache, obj));
+    }
+  cache->slab_cnt++;
+  cache->free_slots += cache->slots_per_slab;
+  return true;
+}
+
+/* Obtains and returns an object from CACHE.
+   Returns a null pointer if memory is not available. */
+void *
+slab_alloc (struct slab_cache *cache)
+{
+  void *obj;
+
+  lock_acquire (&cache->lock);
+  if (list_empty (&cache->free_list) && !grow_cache (cache))
+    {
+      lock_release (&cache->lock);
+      return NULL;
+    }
+
+  obj = link_to_obj (cache, list_pop_front (&cache->free_list));
+  obj_to_slab (obj)->free_cnt--;
+  cache->free_slots--;
+  cache->alloc_cnt++;
+  if (++cache->in_use > cache->peak_in_use)
+    cache->peak_in_use = cache->in_use;
+  lock_release (&cache->lock);
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from slab_alloc(),
+   to its cache. */
+void
+slab_free (void *obj)
+{
+  struct slab *s;
+  struct slab_cache *cache;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (obj);
+  cache = s->cache;
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     it has to keep its constructed state. */
+  if (cache->ctor == NULL)
+    memset (obj, 0xcc, cache->obj_size);
+#endif
+
+  lock_acquire (&cache->lock);
+  list_push_front (&cache->free_list, obj_to_link (cache, obj));
+  cache->free_slots++;
+  cache->free_cnt++;
+  cache->in_use--;
+
+  /* If the slab is now entirely unused and the cache has another
+     slab's worth of free slots, free it. */
+  if (++s->free_cnt >= cache->slots_per_slab
+      && cache->free_slots - s->free_cnt >= cache->slots_per_slab)
+    {
+      size_t i;
+
+      ASSERT (s->free_cnt == cache->slots_per_slab);
+      for (i = 0; i < cache->slots_per_slab; i++)
+        list_remove (obj_to_link (cache, slab_to_obj (s, i)));
+      cache->free_slots -= cache->slots_per_slab;
+      cache->slab_cnt--;
+      palloc_free_page (s);
+    }
+  lock_release (&cache->lock);
+}
+
+/* Returns true if P points into a slab, that is, if it was
+   obtained from slab_alloc() rather than malloc(). */
+bool
+slab_owns (const void *p)
+{
+  const struct slab *s = pg_round_down (p);
+  return s->magic == SLAB_MAGIC;
+}
+
+/* Unregisters CACHE, none of whose objects may be in use, and
+   gives its slabs back to the page allocator. */
+void
+slab_cache_destroy (struct slab_cache *cache)
+{
+  ASSERT (cache->in_use == 0);
+
+  lock_acquire (&all_caches_lock);
+  list_remove (&cache->elem);
+  lock_release (&all_caches_lock);
+
+  while (!list_empty (&cache->free_list))
+    {
+      void *obj = link_to_obj (cache, list_front (&cache->free_list));
+      struct slab *s = obj_to_slab (obj);
+      size_t i;
+
+      for (i = 0; i < cache->slots_per_slab; i++)
+        list_remove (obj_to_link (cache, slab_to_obj (s, i)));
+      palloc_free_page (s);
+    }
+  cache->slab_cnt = 0;
+  cache->free_slots = 0;
+}
+
+/* Prints usage statistics for every cache that has been used.
+   Called at shutdown, possibly from a panic, so it reads the
+   counters without locking. */
+void
+slab_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct slab_cache *c = list_entry (e, struct slab_cache, elem);
+      if (c->alloc_cnt == 0)
+        continue;
+      printf ("Cache %s: %zu-byte slots, %zu in use (peak %zu), "
+              "%zu slabs, %"PRIu64" allocs, %"PRIu64" frees\n",
+              c->name, c->slot_size, c->in_use, c->peak_in_use,
+              c->slab_cnt, c->alloc_cnt, c->free_cnt);
+    }
+}
+
+/* Returns the slab that object OBJ is inside. */
+static struct slab *
+obj_to_slab (const void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid. */
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT (pg_ofs (obj) >= SLAB_HDR_SIZE);
+  ASSERT ((pg_ofs (obj) - SLAB_HDR_SIZE) % s->cache->slot_size == 0);
+
+  return s;
+}
+
+/* Returns the IDX'th object within slab S. */
+static void *
+slab_to_obj (struct slab *s, size_t idx)
+{
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (idx < s->cache->slots_per_slab);
+  return (uint8_t *) s + SLAB_HDR_SIZE + idx * s->cache->slot_size;
+}
+
+/* Returns the free list link of object OBJ in CACHE. */
+static struct list_elem *
+obj_to_link (struct slab_cache *cache, void *obj)
+{
+  return (struct list_elem *) ((uint8_t *) obj + cache->link_ofs);
+}
+
+/* Returns the object whose free list link is E in CACHE. */
+static void *
+link_to_obj (struct slab_cache *cache, struct list_elem *e)
+{
+  return (uint8_t *) e - cache->link_ofs;
+}
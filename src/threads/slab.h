@@ -0,0 +1,45 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Object cache.
+
+   Hands out objects of one fixed size, packed into page-sized
+   slabs with no rounding beyond pointer alignment.  See slab.c
+   for details. */
+struct slab_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of an object in bytes. */
+    size_t slot_size;           /* Size of each slot in bytes. */
+    size_t link_ofs;            /* Offset of free list link in a slot. */
+    size_t slots_per_slab;      /* Number of slots in a slab. */
+    void (*ctor) (void *);      /* Constructor, or a null pointer. */
+    struct list free_list;      /* Free slots of all slabs. */
+    struct lock lock;           /* Lock. */
+    struct list_elem elem;      /* Element in list of all caches. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Slabs currently held. */
+    size_t free_slots;          /* Slots on free_list. */
+    size_t in_use;              /* Objects currently allocated. */
+    size_t peak_in_use;         /* Maximum value of in_use. */
+    uint64_t alloc_cnt;         /* Number of slab_alloc() calls. */
+    uint64_t free_cnt;          /* Number of slab_free() calls. */
+  };
+
+void slab_init (void);
+void slab_cache_init (struct slab_cache *, const char *name, size_t size,
+                      void (*ctor) (void *));
+void slab_cache_destroy (struct slab_cache *);
+void *slab_alloc (struct slab_cache *) __attribute__ ((malloc));
+void slab_free (void *);
+bool slab_owns (const void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
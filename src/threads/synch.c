@@ -344,6 +344,7 @@ void rwsema_init(struct rw_semaphore* rwsema)
 	list_init(&rwsema->read_waiters);
 	list_init(&rwsema->write_waiters);
 	rwsema->writer = NULL;
+	rwsema->readers_passed = false;
 }
 
 /* This function acquires exclusive lock access for a writer if there are no readers or
@@ -361,11 +362,13 @@ void down_write(struct rw_semaphore* rwsema)
   }
 	intr_set_level(old_level);
 }
-/* This function acquires shared lock for a reader or places it on the reader_list if there is a writer*/
+/* This function acquires shared lock for a reader or places it on the reader_list if there is a writer.
+ * A reader also waits while a writer is queued, so that a steady stream of readers cannot starve writers.
+ */
 void down_read(struct rw_semaphore* rwsema)
 {
 	enum intr_level old_level = intr_disable();
-	if(rwsema->writer == NULL) {
+	if(rwsema->writer == NULL && list_empty(&rwsema->write_waiters)) {
 		++rwsema->rcount;
   }
 	else {
@@ -376,21 +379,29 @@ void down_read(struct rw_semaphore* rwsema)
 }
 /*
  * This function releases exclusive write access to the lock, and then gives access to the
- * next writer waiting if one exists, or else to any waiting readers.
+ * next writer waiting if one exists, or else to all waiting readers. Readers that already
+ * waited through this writer go before the next one, so that writers and batches of readers
+ * take turns and a stream of writers cannot starve readers.
  */
 void up_write(struct rw_semaphore* rwsema)
 {
   enum intr_level old_level = intr_disable();
 	ASSERT(rwsema->writer == thread_current());
   rwsema->writer = NULL;
-  if (!list_empty(&rwsema->write_waiters)) {
+  if (!list_empty(&rwsema->write_waiters)
+      && !(rwsema->readers_passed && !list_empty(&rwsema->read_waiters))) {
     struct thread* t = list_entry(list_pop_front(&rwsema->write_waiters), struct thread, elem);
     rwsema->writer = t;
+    rwsema->readers_passed = !list_empty(&rwsema->read_waiters);
     thread_unblock(t);
-  } else if (!list_empty(&rwsema->read_waiters)) {
-    struct thread* t = list_entry(list_pop_front(&rwsema->read_waiters), struct thread, elem);
-    ++rwsema->rcount;
-    thread_unblock(t);
+  } else {
+    rwsema->readers_passed = false;
+    // Readers share the lock, so every waiting reader gets in
+    while (!list_empty(&rwsema->read_waiters)) {
+      struct thread* t = list_entry(list_pop_front(&rwsema->read_waiters), struct thread, elem);
+      ++rwsema->rcount;
+      thread_unblock(t);
+    }
   }
   intr_set_level(old_level);
 }
@@ -406,6 +417,7 @@ void up_read(struct rw_semaphore* rwsema)
   if (rwsema->rcount == 0 && !list_empty(&rwsema->write_waiters)) {
     struct thread* t = list_entry(list_pop_front(&rwsema->write_waiters), struct thread, elem);
     rwsema->writer = t;
+    rwsema->readers_passed = !list_empty(&rwsema->read_waiters);
     thread_unblock(t);
   }
   intr_set_level(old_level);
@@ -47,6 +47,7 @@ struct rw_semaphore
     struct list read_waiters;        
     struct list write_waiters;
     struct thread *writer;
+    bool readers_passed;             /* Readers waited through WRITER. */
   };
 
 void rwsema_init(struct rw_semaphore*);
@@ -14,9 +14,10 @@
 #include "threads/vaddr.h"
 #include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "threads/pipe.h"
-#include "filesys/file.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -84,6 +85,12 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void free_fd (struct file_descriptor *);
+
+/* Object caches for process and file descriptors, which malloc()
+   would round up to the next power of 2. */
+static struct slab_cache pd_cache;
+static struct slab_cache fd_cache;
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -119,6 +126,11 @@ thread_init (void)
 void
 thread_start (void) 
 {
+  slab_cache_init (&pd_cache, "process_descriptor",
+                   sizeof (struct process_descriptor), NULL);
+  slab_cache_init (&fd_cache, "file_descriptor",
+                   sizeof (struct file_descriptor), NULL);
+
   /* Create the idle thread. */
   struct semaphore idle_started;
   sema_init (&idle_started, 0);
@@ -184,6 +196,7 @@ thread_create (const char *name, int priority,
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  enum intr_level old_level;
   tid_t tid;
 
   ASSERT (function != NULL);
@@ -215,7 +228,9 @@ thread_create (const char *name, int priority,
   /* Set up process descriptor for parent/child relationship */
   struct thread* parent = thread_current();
   // To be freed by parent
-  struct process_descriptor* pd = malloc(sizeof(struct process_descriptor));
+  struct process_descriptor* pd = slab_alloc(&pd_cache);
+  if (pd == NULL)
+    goto fail;
   pd->child = t;
   pd->exit_status = -1;
   pd->is_exited = false;
@@ -226,31 +241,127 @@ thread_create (const char *name, int priority,
 
   list_push_back(&parent->children, &pd->elem);
 
-  copy_fdt(parent, t);
+  if (!copy_fdt(parent, t, false)) {
+    list_remove(&pd->elem);
+    slab_free(pd);
+    goto fail;
+  }
+
+#ifdef FILESYS
+  // The child starts in its parent's working directory
+  if (parent->cwd != NULL)
+    t->cwd = dir_reopen(parent->cwd);
+#endif
 
   /* Add to run queue. */
   thread_unblock (t);
 
   return tid;
-}
 
-void
-copy_fdt(struct thread* parent, struct thread* child) {
+ fail:
+  /* Out of memory: close what was passed on and free the thread,
+     which never ran. */
+  for (int i = 0; i < 64; i++)
+    free_fd(t->fdt[i]);
+  old_level = intr_disable ();
+  list_remove (&t->allelem);
+  intr_set_level (old_level);
+  palloc_free_page (t);
+  return TID_ERROR;
+}
+
+/* Duplicates the parent's file descriptors into the child.  A fork
+   copies every descriptor to the same slot, files are reopened at the
+   same position and pipes gain another reader or writer.  Otherwise only
+   a pipe reader is passed on, as the child's stdin.  Returns false if
+   out of memory, leaving the descriptors copied so far to be closed when
+   the child exits. */
+bool
+copy_fdt(struct thread* parent, struct thread* child, bool whole) {
+  if (whole) {
+    for (int i = 0; i < 64; ++i) {
+      // Drop what thread_create() already passed on
+      free_fd(child->fdt[i]);
+      child->fdt[i] = NULL;
+
+      struct file_descriptor* fd = parent->fdt[i];
+      if (fd == NULL) continue;
+
+      struct file_descriptor* copy = fd_alloc();
+      if (copy == NULL) return false;
+      *copy = *fd;
+      if (fd->type == FILE) {
+#ifdef FILESYS
+        copy->file = file_reopen(fd->file);
+        if (copy->file == NULL) {
+          slab_free(copy);
+          return false;
+        }
+        file_seek(copy->file, file_tell(fd->file));
+#endif
+      } else if (fd->type == DIRECTORY) {
+#ifdef FILESYS
+        copy->dir = dir_reopen(fd->dir);
+        if (copy->dir == NULL) {
+          slab_free(copy);
+          return false;
+        }
+#endif
+      } else if (fd->type == PIPE_READER) {
+        pipe_add_reader(fd->pipe);
+      } else if (fd->type == PIPE_WRITER) {
+        pipe_add_writer(fd->pipe);
+      }
+      child->fdt[i] = copy;
+    }
+    return true;
+  }
+
   // Copy pipe if exists
   for (int i = 0; i < 64; ++i) {
     struct file_descriptor* fd = parent->fdt[i];
     if (fd != NULL && fd->type == PIPE_READER) {
-      child->fdt[0] = malloc(sizeof(struct file_descriptor));
+      child->fdt[0] = fd_alloc();
+      if (child->fdt[0] == NULL) return false;
       child->fdt[0]->type = PIPE_READER;
       child->fdt[0]->file = NULL;
       child->fdt[0]->pipe = fd->pipe;
-      ++fd->pipe->num_readers;
+      pipe_add_reader(fd->pipe);
       break;
     }
   }
 
   // Currently not copying remainder of fdt because the tests
   // do not require it
+  return true;
+}
+
+/* Closes the file, directory or pipe end behind FD and frees it. */
+static void
+free_fd(struct file_descriptor* fd) {
+  if (fd == NULL) return;
+
+  if (fd->type == FILE) {
+#ifdef FILESYS
+    file_close(fd->file);
+#endif
+  } else if (fd->type == DIRECTORY) {
+#ifdef FILESYS
+    dir_close(fd->dir);
+#endif
+  } else if (fd->type == PIPE_READER) {
+    pipe_close_reader(fd->pipe);
+  } else if (fd->type == PIPE_WRITER) {
+    pipe_close_writer(fd->pipe);
+  }
+  slab_free(fd);
+}
+
+/* Returns a new, uninitialized file descriptor, or a null pointer
+   if memory is not available.  Released with slab_free(). */
+struct file_descriptor *
+fd_alloc(void) {
+  return slab_alloc(&fd_cache);
 }
 
 /* Puts the current thread to sleep.  It will not be scheduled
@@ -396,22 +507,15 @@ thread_exit (void)
     next = list_next(e);
     list_remove(e);
 
-    free(pd);
+    slab_free(pd);
   }
 
-  for(int i = 0; i < 64; i++) {
-    struct file_descriptor* fd = cur->fdt[i];
-    if (fd == NULL) continue;
-
-    if (fd->type == FILE) {
-      file_close(fd->file);
-    } else if (fd->type == PIPE_READER) {
-      pipe_close_reader(fd->pipe);
-    } else if (fd->type == PIPE_WRITER) {
-      pipe_close_writer(fd->pipe);
-    }
-    free(fd);
-  }
+  for(int i = 0; i < 64; i++)
+    free_fd(cur->fdt[i]);
+#ifdef FILESYS
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
+#endif
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
@@ -522,6 +626,12 @@ idle (void *idle_started_ UNUSED)
 
   for (;;) 
     {
+      /* Clear free pages ahead of PAL_ZERO allocations while
+         nobody else wants the CPU.  One page at a time, so that a
+         thread woken by an interrupt waits for at most one page. */
+      while (list_empty (&ready_list) && palloc_zero_idle ())
+        continue;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -596,6 +706,10 @@ init_thread (struct thread *t, const char *name, int priority)
   t->pd = NULL; // Will be initialized in thread_create
   t->running_file = NULL;
   memset(t->fdt, 0, sizeof(t->fdt));
+  list_init(&t->vm_list);
+  lock_init(&t->vm_lock);
+  list_init(&t->mmap_list);
+  t->next_mapid = 0;
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
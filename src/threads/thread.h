@@ -3,6 +3,7 @@
 
 #include <debug.h>
 #include <list.h>
+#include <memstat.h>
 #include <stdint.h>
 #include "threads/synch.h"
 
@@ -40,13 +41,15 @@ struct process_descriptor {
 enum fdtype {
    FILE,
    PIPE_READER,
-   PIPE_WRITER
+   PIPE_WRITER,
+   DIRECTORY
 };
 
 struct file_descriptor {
    struct file* file;
    enum fdtype type;
    struct pipe* pipe;
+   struct dir* dir;
 };
 
 /* A kernel thread or user process.
@@ -117,6 +120,11 @@ struct thread
     int64_t wakeup_tick;	        /* Tick till wake up.  */
     struct file_descriptor* fdt[64];               /* File descriptor table. */
     struct file* running_file;	        /*The file containing the program/executable */
+    struct dir* cwd;                    /* Working directory, NULL for the root. */
+    int journal_depth;                  /* Nesting of journaled file system
+                                           operations. */
+    int journal_credits;                /* Journal sectors reserved by the
+                                           outermost one and not used. */
     struct process_descriptor* pd;      /* Process descriptor for parent/child relationship */
     struct list children;               /* A list of procescs_descriptor* children */
     /* Shared between thread.c and synch.c. */
@@ -124,6 +132,13 @@ struct thread
 
     /*Struct for saving vm_entries for each page*/
     struct list vm_list;
+    struct lock vm_lock;                /* Serializes loading pages with prefetch. */
+    struct list mmap_list;              /* Files mapped with mmap. */
+    int next_mapid;                     /* Map id for the next mmap. */
+    struct memstat memstat;             /* Fault and working set counts. */
+    unsigned wss_period;                /* Sample period of wss_count,
+                                           0 before the first. */
+    unsigned wss_count;                 /* Pages accessed in that period. */
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
@@ -147,7 +162,8 @@ void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
-void copy_fdt(struct thread* parent, struct thread* child);
+bool copy_fdt(struct thread* parent, struct thread* child, bool whole);
+struct file_descriptor *fd_alloc(void);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
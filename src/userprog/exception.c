@@ -7,7 +7,9 @@
 #include "userprog/syscall.h"
 #include "threads/pte.h"
 #include "userprog/process.h"
+#include "userprog/uaccess.h"
 #include "vm/page.h"
+#include "vm/frame.h"
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
@@ -153,27 +155,52 @@ page_fault (struct intr_frame *f)
   user = (f->error_code & PF_U) != 0;
 
  bool loaded = false;
+ bool major = false;
+ bool retry = false;
  /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
-  if(!is_kernel_vaddr(fault_addr) && is_user_vaddr(fault_addr) && not_present)
+  if(!is_kernel_vaddr(fault_addr) && is_user_vaddr(fault_addr))
   {
+	  struct thread* cur = thread_current();
+
+	  lock_acquire(&cur->vm_lock);
 	  struct vm_entry* vme = vm_entry_find(fault_addr);
 	  if(vme != NULL)
 	  {
 		  if(write && !vme->is_write)
 			 loaded = false;
-		  else
-		  	loaded = handle_mm_fault(vme);
+		  else if(not_present && vme->is_loaded && frame_wait_io(vme))
+			  retry = true; // Resident after all, no fault to count
+		  else if(not_present)
+		  	loaded = handle_mm_fault(vme, write, &major);
+		  else if(write && vme->type == PAGE_FILE)
+		  {
+			  frame_write_file(vme); // First write since the page was clean
+			  loaded = true;
+		  }
+		  else if(write)
+			  loaded = frame_cow(vme); // Write to a page shared since fork
+	  }
+	  lock_release(&cur->vm_lock);
 
-		  if(loaded)
-			  return;
+	  if(retry)
+		  return;
+	  if(loaded)
+	  {
+		  if(major)
+			  cur->memstat.major_faults++;
+		  else
+			  cur->memstat.minor_faults++;
+		  return;
 	  }
-	  else
-		  loaded = false;
-		  
   }
 
+  /* A bad user address passed to a system call makes the copy
+     from or to it fail rather than killing the process. */
+  if(!loaded && !user && uaccess_fixup(f))
+	  return;
+
   if(!loaded)
 	  exit_(-1);
 
@@ -19,8 +19,12 @@
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
 #include "vm/page.h"
+#include "vm/frame.h"
+#include "vm/prefetch.h"
+#include "vm/swap.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
 /* Starts a new thread running a user program loaded from
@@ -84,8 +88,6 @@ start_process (void *command_line_input_)
   }
   struct thread* cur = thread_current();
 
-  list_init(&cur->vm_list);
-
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
@@ -120,6 +122,135 @@ start_process (void *command_line_input_)
   NOT_REACHED ();
 }
 
+/* What start_fork() needs from the parent, which stays blocked in
+   the fork syscall until the child signals exec_sema. */
+struct fork_args
+  {
+    struct thread *parent;
+    struct intr_frame *if_;     /* Parent's user context at the syscall. */
+  };
+
+/* Starts a copy of the current process that resumes from the fork
+   syscall described by IF_.  Returns the child's thread id, or
+   TID_ERROR if the thread cannot be created. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct thread *cur = thread_current ();
+  struct fork_args *args;
+  tid_t tid;
+
+  args = malloc (sizeof *args);
+  if (args == NULL)
+    return TID_ERROR;
+  args->parent = cur;
+  args->if_ = if_;
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, args);
+  if (tid == TID_ERROR)
+    free (args);
+  return tid;
+}
+
+/* Duplicates the parent's page of VME into the current process. */
+static bool
+fork_vm_entry (struct vm_entry *vme, struct file *file, struct list *mmap_vmes)
+{
+  struct vm_entry *copy = vm_entry_init (vme->vaddr, vme->type, vme->is_write,
+                                         file, vme->offset, vme->read_bytes,
+                                         vme->zero_bytes);
+  if (copy == NULL)
+    return false;
+  if (mmap_vmes != NULL)
+    list_push_back (mmap_vmes, &copy->mmap_elem);
+  return frame_fork (vme, copy);
+}
+
+/* Duplicates the parent's address space, mappings and file
+   descriptors, sharing resident pages copy-on-write instead of
+   reloading the executable, then returns 0 to user space. */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *parent = args->parent;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_;
+  struct list_elem *e;
+  bool success = false;
+
+  memcpy (&if_, args->if_, sizeof if_);
+  free (args);
+
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    goto done;
+  process_activate ();
+
+  cur->running_file = file_reopen (parent->running_file);
+  if (cur->running_file == NULL)
+    goto done;
+  file_deny_write (cur->running_file);
+
+  /* The parent's pages must not be loaded by prefetching while
+     they are being shared. */
+  lock_acquire (&parent->vm_lock);
+
+  /* Mapped pages are copied along with their mapping below. */
+  for (e = list_begin (&parent->vm_list); e != list_end (&parent->vm_list);
+       e = list_next (e))
+    {
+      struct vm_entry *vme = list_entry (e, struct vm_entry, list_elem);
+      if (vme->type != PAGE_FILE
+          && !fork_vm_entry (vme, cur->running_file, NULL))
+        goto done;
+    }
+
+  for (e = list_begin (&parent->mmap_list); e != list_end (&parent->mmap_list);
+       e = list_next (e))
+    {
+      struct mmap_file *parent_mf = list_entry (e, struct mmap_file, elem);
+      struct mmap_file *mf = malloc (sizeof *mf);
+      if (mf == NULL)
+        goto done;
+      mf->mapid = parent_mf->mapid;
+      mf->file = file_reopen (parent_mf->file);
+      list_init (&mf->vme_list);
+      list_push_back (&cur->mmap_list, &mf->elem);
+      if (mf->file == NULL)
+        goto done;
+
+      struct list_elem *m;
+      for (m = list_begin (&parent_mf->vme_list);
+           m != list_end (&parent_mf->vme_list); m = list_next (m))
+        if (!fork_vm_entry (list_entry (m, struct vm_entry, mmap_elem),
+                            mf->file, &mf->vme_list))
+          goto done;
+    }
+  cur->next_mapid = parent->next_mapid;
+
+  if (!copy_fdt (parent, cur, true))
+    goto done;
+  success = true;
+
+ done:
+  if (lock_held_by_current_thread (&parent->vm_lock))
+    lock_release (&parent->vm_lock);
+  if (!success)
+    {
+      cur->pd->tid = -1;
+      cur->pd->is_exited = true;
+      sema_up (&cur->pd->exec_sema);
+      thread_exit ();
+    }
+  sema_up (&cur->pd->exec_sema);
+
+  /* The child sees fork() return 0. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 void
 init_stack(int argc, char** argv, void **p) {
   char **new_argv = (char **)malloc((argc + 1) * sizeof(char *));
@@ -208,6 +339,15 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+  if (cur->pagedir != NULL)
+    {
+      prefetch_cancel (cur);
+      vm_print_memstat ();
+    }
+
+  // Unmapping writes dirty pages back, so do it before the rest of the pages go
+  while (!list_empty(&cur->mmap_list))
+    do_munmap(list_entry(list_front(&cur->mmap_list), struct mmap_file, elem));
   file_close(cur->running_file);
   free_vm_list(&cur->vm_list);
   /* Destroy the current process's page directory and switch back
@@ -431,7 +571,8 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
+static bool install_page (struct thread *, void *upage, void *kpage,
+                          bool writable);
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -508,8 +649,10 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
          and zero the final PAGE_ZERO_BYTES bytes. */
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
-      
-      struct vm_entry * vme = vm_entry_init(upage, PAGE_ELF, writable,file,ofs, page_read_bytes, page_zero_bytes);
+
+      // Pages with nothing to read, such as .bss, are demand-zero
+      enum page_type type = page_read_bytes > 0 ? PAGE_ELF : PAGE_ANON;
+      struct vm_entry * vme = vm_entry_init(upage, type, writable,file,ofs, page_read_bytes, page_zero_bytes);
       if(vme == NULL)
       {
 	      return false;
@@ -524,38 +667,22 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Create a minimal stack by reserving a demand-zero page at the
+   top of user virtual memory.  It gets a frame when init_stack()
+   first writes to it. */
 static bool
 setup_stack (void **esp) 
 {
-  uint8_t *kpage;
-  bool success = false;
-
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
-    {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (!success)
-      {
-        palloc_free_page (kpage);
-	return false;
-      }
-    
   struct vm_entry* vme = vm_entry_init(((uint8_t *) PHYS_BASE) - PGSIZE, PAGE_ANON, true, NULL, 0, 0, 0);
-  
-  if(vme == NULL)
-  {
-	  palloc_free_page(kpage);
-	  success = false;
-  }
+  if (vme == NULL)
+    return false;
+
   *esp = PHYS_BASE;
-    }
-  return success;
+  return true;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
+   virtual address KPAGE to the page table of T.
    If WRITABLE is true, the user process may modify the page;
    otherwise, it is read-only.
    UPAGE must not already be mapped.
@@ -564,52 +691,101 @@ setup_stack (void **esp)
    Returns true on success, false if UPAGE is already mapped or
    if memory allocation fails. */
 static bool
-install_page (void *upage, void *kpage, bool writable)
+install_page (struct thread *t, void *upage, void *kpage, bool writable)
 {
-  struct thread *t = thread_current ();
-
   /* Verify that there's not already a page at that virtual
      address, then map our page there. */
   return (pagedir_get_page (t->pagedir, upage) == NULL 
 		  && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
 
-bool handle_mm_fault(struct vm_entry* vm)
+/* Pages read ahead after a major fault on a page advised
+   MADV_SEQUENTIAL. */
+#define READ_AHEAD_PAGES 8
+
+/* Loads the page of VM, which is not resident, into its process.
+   WRITE is true if the page is about to be written.  Sets *MAJOR to
+   true if the page had to be read from a file or from swap. */
+static bool load_page(struct vm_entry* vm, bool write, bool* major)
 {
-	void* pg;
-	pg = palloc_get_page(PAL_USER);
-	if(pg == NULL)
-		return false;
-	if(vm->type == PAGE_FILE)
-	{
-		//TODO RETURN FALSE FOR NOW
-		return false;
+	bool is_text = vm->type == PAGE_ELF && !vm->is_write;
 
-	}
-	else if(vm->type == PAGE_ANON)
-	{
-		return false;
-	}
-	else if(vm->type == PAGE_SWAP)
-	{
+	*major = false;
+
+	// Another process running the same executable may have the page already
+	if(is_text && frame_share_text(vm))
+		return true;
+
+	// Reading untouched anonymous memory costs no frame until it is written
+	if(vm->type == PAGE_ANON && !write)
+		return frame_map_zero(vm);
+
+	struct frame* frame = frame_alloc(vm->type == PAGE_ANON ? PAL_ZERO : 0, vm);
+	if(frame == NULL)
 		return false;
+	void* pg = frame->kaddr;
 
-	}
-	else if(vm->type == PAGE_ELF)
+	switch(vm->type)
 	{
+	case PAGE_ELF:
+	case PAGE_FILE:
+		*major = vm->read_bytes > 0;
 		if(!load_file(pg, vm))
 		{
-			palloc_free_page(pg);
+			frame_free(vm);
 			return false;
 		}
-		if(!install_page(vm->vaddr, pg, vm->is_write))
-		{
-			palloc_free_page(pg);
-			return false;
+		break;
+	case PAGE_ANON:
+		break;
+	case PAGE_SWAP:
+		*major = true;
+		swap_in(vm->swap_slot, pg);
+		vm->swap_slot = -1;
+		break;
+	}
 
-		}
-		return true;
+	// Mmap pages stay read-only until written, so that their frame is known dirty
+	if(!install_page(vm->thread, vm->vaddr, pg, vm->is_write && vm->type != PAGE_FILE))
+	{
+		frame_free(vm);
+		return false;
+	}
+	vm->is_loaded = true;
+	if(vm->type == PAGE_FILE && write)
+		frame_write_file(vm);
+	if(is_text)
+		frame_cache_text(frame, vm);
+	frame->pinned = false;
+	return true;
+}
 
+/* Loads up to READ_AHEAD_PAGES pages following VM, stopping at the first
+   one that is resident, not advised MADV_SEQUENTIAL or anonymous, which
+   a fault would not have to read in. */
+static void read_ahead(struct vm_entry* vm)
+{
+	bool major;
+
+	for(int i = 1; i <= READ_AHEAD_PAGES; ++i)
+	{
+		struct vm_entry* next = vm_entry_find_in(vm->thread, vm->vaddr + i * PGSIZE);
+		if(next == NULL || next->is_loaded || next->advice != MADV_SEQUENTIAL
+		   || next->type == PAGE_ANON || !load_page(next, false, &major))
+			break;
 	}
-	return false;
+}
+
+/* Brings in the page of VM after a fault on it, or for prefetching.
+   WRITE is true if the faulting access was a write.  Sets *MAJOR to
+   true if the page had to be read from a file or from swap, in which
+   case the following pages are read too if VM is advised sequential.
+   The vm_lock of VM's process must be held. */
+bool handle_mm_fault(struct vm_entry* vm, bool write, bool* major)
+{
+	if(!load_page(vm, write, major))
+		return false;
+	if(*major && vm->advice == MADV_SEQUENTIAL)
+		read_ahead(vm);
+	return true;
 }
@@ -2,12 +2,14 @@
 #define USERPROG_PROCESS_H
 
 #include "threads/thread.h"
+#include "threads/interrupt.h"
 #include <stdbool.h>
 #include "vm/page.h"
 tid_t process_execute (const char *file_name);
+tid_t process_fork (struct intr_frame *);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
 void init_stack(int, char**, void**);
-bool handle_mm_fault(struct vm_entry*);
+bool handle_mm_fault(struct vm_entry*, bool, bool*);
 #endif /* userprog/process.h */
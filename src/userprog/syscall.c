@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -8,29 +9,68 @@
 #include "threads/synch.h"
 #include "userprog/pagedir.h"
 #include "threads/vaddr.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include <stdlib.h>
 #include "userprog/process.h"
 #include "threads/malloc.h"
 #include "threads/pipe.h"
+#include "vm/page.h"
+#include "vm/prefetch.h"
+#include <round.h>
+#include "userprog/uaccess.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 
 static void syscall_handler (struct intr_frame *);
+static pid_t wait_for_load(pid_t);
 
-static struct lock filesys_lock;
-
-/*Initializes lock and interrupt vector for syscall handling*/
+/*Initializes pipes and the interrupt vector for syscall handling. The file
+ * system does its own locking, so no lock is taken around its calls*/
 void
 syscall_init (void) 
 {
-  lock_init(&filesys_lock);
+  pipe_cache_init();
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
-/*Handles syscall functions from user and takes inputs from the user stack*/
+/*Copies SIZE bytes from user address USRC to DST, and exits with status -1
+ * if they cannot be read*/
+static void copy_in(void* dst, const void* usrc, size_t size)
+{
+  if (!copy_from_user(dst, usrc, size))
+    exit_(-1);
+}
+
+/*Returns a copy of the user string USTR in a new page, to be freed with
+ * palloc_free_page(), or NULL if it does not fit in a page or no page is
+ * available. Exits with status -1 if USTR cannot be read*/
+static char* copy_in_string(const char* ustr)
+{
+  char* kstr = palloc_get_page(0);
+  if (kstr == NULL)
+    return NULL;
+
+  int len = strncpy_from_user(kstr, ustr, PGSIZE);
+  if (len < 0) {
+    palloc_free_page(kstr);
+    exit_(-1);
+  }
+  if (len == PGSIZE) {
+    palloc_free_page(kstr);
+    return NULL;
+  }
+  return kstr;
+}
+
+/*Handles syscall functions from user and copies their arguments from the
+ * user stack, exiting with status -1 if the stack cannot be read*/
 static void
 syscall_handler (struct intr_frame *f) 
 {
-  int syscall_num = *((int*)f->esp);
+  int syscall_num;
+  copy_in(&syscall_num, f->esp, sizeof syscall_num);
 
   // Address of first argument - may or may not be used
   void* addr1 = f->esp + sizeof(int);
@@ -42,119 +82,173 @@ syscall_handler (struct intr_frame *f)
       }
     case SYS_EXIT:
       {
-      if (!validate_pointer(addr1)) exit_(-1);
-      int status = *(int*)(addr1);
+      int status;
+      copy_in(&status, addr1, sizeof status);
       exit_(status);
       break;
       }
     case SYS_EXEC:
       {
-      if (!validate_pointer(addr1)) exit_(-1);
-      char* cmd_line = *(char**)(addr1);
+      const char* cmd_line;
+      copy_in(&cmd_line, addr1, sizeof cmd_line);
       f->eax = exec(cmd_line);
       break;
       }
     case SYS_WAIT:
       {
-      if (!validate_pointer(addr1)) exit_(-1);
-      pid_t pid = *(pid_t*)(addr1);
+      pid_t pid;
+      copy_in(&pid, addr1, sizeof pid);
       f->eax = wait(pid);
       break;
       }
     case SYS_CREATE:
       {
-      void* addr2 = addr1 + sizeof(char*);
-      if (!validate_pointer(addr1) || !validate_pointer(addr2)) exit_(-1);
-      const char *file = *(char **)(addr1);
-      unsigned initial_size = *(unsigned *)(addr2);
-      f->eax = create(file, initial_size);
+      struct { const char* file; unsigned initial_size; } args;
+      copy_in(&args, addr1, sizeof args);
+      f->eax = create(args.file, args.initial_size);
       break;
       }
     case SYS_REMOVE:
       {
-      if (!validate_pointer(addr1)) exit_(-1);
-      const char* file = *(char **)(addr1);
+      const char* file;
+      copy_in(&file, addr1, sizeof file);
       f->eax = remove(file);
       break;
       }
     case SYS_OPEN:
       {
-      if (!validate_pointer(addr1)) exit_(-1);
-      const char* file = *(char **)(addr1);
+      const char* file;
+      copy_in(&file, addr1, sizeof file);
       f->eax = open(file);
       break;
       }
     case SYS_FILESIZE:
       {
-      if (!validate_pointer(addr1)) exit_(-1);
-      int fd = *(int*)(addr1);
+      int fd;
+      copy_in(&fd, addr1, sizeof fd);
       f->eax = filesize(fd);
       break;
       }
     case SYS_READ:
       {
-      void* addr2 = addr1 + sizeof(int);
-      void* addr3 = addr2 + sizeof(void*);
-      if (!validate_pointer(addr1) || !validate_pointer(addr2) || !validate_pointer(addr3)) exit_(-1);
-      int fd = *(int*)(addr1);
-      const void* buffer = *(void**)(addr2);
-      unsigned size = *(unsigned*)(addr3);
-      f->eax = read(fd, buffer, size);
+      struct { int fd; const void* buffer; unsigned size; } args;
+      copy_in(&args, addr1, sizeof args);
+      f->eax = read(args.fd, args.buffer, args.size);
       break;
       }
     case SYS_WRITE:
       {
-      void* addr2 = addr1 + sizeof(int);
-      void* addr3 = addr2 + sizeof(void*);
-      if (!validate_pointer(addr1) || !validate_pointer(addr2) || !validate_pointer(addr3)) exit_(-1);
-      int fd = *(int*)(addr1);
-      const void* buffer = *(void**)(addr2);
-      unsigned size = *(unsigned*)(addr3);
-      f->eax = write(fd, buffer, size);
+      struct { int fd; const void* buffer; unsigned size; } args;
+      copy_in(&args, addr1, sizeof args);
+      f->eax = write(args.fd, args.buffer, args.size);
       break;
       }
     case SYS_SEEK:
       {
-      void* addr2 = addr1 + sizeof(int);
-      if (!validate_pointer(addr1) || !validate_pointer(addr2)) exit_(-1);
-      int fd = *(int*) (addr1);
-      unsigned position = *(unsigned*)(addr2);
-      seek(fd, position);
+      struct { int fd; unsigned position; } args;
+      copy_in(&args, addr1, sizeof args);
+      seek(args.fd, args.position);
       break;
       }
     case SYS_TELL:
       {
-      if (!validate_pointer(addr1)) exit_(-1);
-      int fd = *(int*)(addr1);
+      int fd;
+      copy_in(&fd, addr1, sizeof fd);
       f->eax = tell(fd);
       break;
       }
     case SYS_CLOSE:
       {
-      if (!validate_pointer(addr1)) exit_(-1);
-      int fd = *(int*)(addr1);
+      int fd;
+      copy_in(&fd, addr1, sizeof fd);
       close(fd);
       break;
       }
     case SYS_PIPE:
       {
-      if (!validate_pointer(addr1)) exit_(-1);
-      int* fds = *(int **)(addr1);
+      int* fds;
+      copy_in(&fds, addr1, sizeof fds);
       f->eax = pipe(fds);
       break;
       }
+    case SYS_FORK:
+      {
+      f->eax = fork_(f);
+      break;
+      }
+    case SYS_MEMSTAT:
+      {
+      struct memstat* ms;
+      copy_in(&ms, addr1, sizeof ms);
+      memstat(ms);
+      break;
+      }
+    case SYS_MADVISE:
+      {
+      struct { void* addr; size_t length; int advice; } args;
+      copy_in(&args, addr1, sizeof args);
+      f->eax = madvise(args.addr, args.length, args.advice);
+      break;
+      }
+    case SYS_MMAP:
+      {
+      struct { int fd; void* addr; } args;
+      copy_in(&args, addr1, sizeof args);
+      f->eax = mmap(args.fd, args.addr);
+      break;
+      }
+    case SYS_MUNMAP:
+      {
+      mapid_t mapid;
+      copy_in(&mapid, addr1, sizeof mapid);
+      munmap(mapid);
+      break;
+      }
+    case SYS_CHDIR:
+      {
+      const char* dir;
+      copy_in(&dir, addr1, sizeof dir);
+      f->eax = chdir(dir);
+      break;
+      }
+    case SYS_MKDIR:
+      {
+      const char* dir;
+      copy_in(&dir, addr1, sizeof dir);
+      f->eax = mkdir(dir);
+      break;
+      }
+    case SYS_READDIR:
+      {
+      struct { int fd; char* name; } args;
+      copy_in(&args, addr1, sizeof args);
+      f->eax = readdir(args.fd, args.name);
+      break;
+      }
+    case SYS_ISDIR:
+      {
+      int fd;
+      copy_in(&fd, addr1, sizeof fd);
+      f->eax = isdir(fd);
+      break;
+      }
+    case SYS_INUMBER:
+      {
+      int fd;
+      copy_in(&fd, addr1, sizeof fd);
+      f->eax = inumber(fd);
+      break;
+      }
+    case SYS_FSYNC:
+      {
+      int fd;
+      copy_in(&fd, addr1, sizeof fd);
+      f->eax = fsync(fd);
+      break;
+      }
   }
 }
 
-/*
- * Return false if pointer is null, not mapped to virtual memory, or part of kernel memory
- */
-bool validate_pointer(const void* pointer)
-{
-  // TODO should it be an || between is_user_vaddr and pagedir_get_page?
-	return pointer != NULL && is_user_vaddr(pointer) && pagedir_get_page(thread_current()->pagedir, pointer) != NULL;
-}
-
 /*Get the next unoccupied FD between 2 and 63 otherwise return -1*/
 int get_next_fd()
 {
@@ -181,52 +275,97 @@ void exit_(int status) {
   thread_exit();
 }
 
-/*Returns size when size bytes is written from buffer, otherwise wait
- * If the pointers are invalid, it exits with status -1
+/*Returns the number of bytes written from buffer
+ * The buffer is copied in through a kernel page, a page at a time. A write to
+ * a file holds the file's inode lock for the whole call, so that it is atomic
+ * with respect to other reads and writes of the file. If the disk fills up
+ * midway, returns the number of bytes written before that. If the buffer
+ * cannot be read, exits with status -1, keeping what was written before
  * If FD is invalid or corresponds to NULL, returns -1
  * If trying to write to STDIN, exits with status -1
- * If trying to write to STDOUT, waits for input
+ * If trying to write to STDOUT, writes to the console
  * If trying to write to pipe buffer, calls pipe_write API
  * Else writes to a normal file*/
 
 int write(int fd, const void *buffer, unsigned size) {
-  if (!validate_pointer(buffer)) exit_(-1);
   if(fd < 0 || fd > 63) return -1;
 
   struct thread* cur = thread_current();
 
   if (fd == 0) exit_(-1);
 
-  if (fd == 1) {
-    lock_acquire(&filesys_lock);
-    putbuf(buffer, size);
-    lock_release(&filesys_lock);
-    return size;
+  struct file_descriptor* file_desc = NULL;
+  if (fd != 1) {
+    file_desc = cur->fdt[fd];
+    if (file_desc == NULL || (file_desc->type != FILE && file_desc->type != PIPE_WRITER))
+      return -1;
   }
 
-  struct file_descriptor* file_desc = cur->fdt[fd];
-  if (file_desc == NULL) return -1;
+  char* kbuf = palloc_get_page(0);
+  if (kbuf == NULL) return -1;
 
-  int result = 0;
-  if (file_desc->type == FILE) {
-    lock_acquire(&filesys_lock);
-    result = file_write(file_desc->file, buffer, size);
-    lock_release(&filesys_lock);
+  struct inode* inode = NULL;
+  if (file_desc != NULL && file_desc->type == FILE) {
+    inode = file_get_inode(file_desc->file);
+    inode_lock(inode);
   }
-  else if (file_desc->type == PIPE_WRITER)
-    result = pipe_write(file_desc->pipe, buffer, size);
-  else
-    result = -1;
 
-  return result;
+  unsigned written = 0;
+  while (written < size) {
+    unsigned chunk = size - written < PGSIZE ? size - written : PGSIZE;
+    if (!copy_from_user(kbuf, buffer + written, chunk)) {
+      if (inode != NULL) inode_unlock(inode);
+      palloc_free_page(kbuf);
+      exit_(-1);
+    }
+
+    int result;
+    if (file_desc == NULL) {
+      putbuf(kbuf, chunk);
+      result = chunk;
+    }
+    else if (file_desc->type == FILE) {
+      result = file_write(file_desc->file, kbuf, chunk);
+    }
+    else
+      result = pipe_write(file_desc->pipe, kbuf, chunk);
+
+    if (result < 0) {
+      // A pipe with no readers left
+      palloc_free_page(kbuf);
+      return written > 0 ? (int) written : -1;
+    }
+    written += result;
+    if ((unsigned) result < chunk)
+      break;
+  }
+  if (inode != NULL) inode_unlock(inode);
+  palloc_free_page(kbuf);
+  return written;
 }
 
 /*Creates a new process and executes it after taking input from command line
  * New process is added to child list of the parent process and returns its
  * process ID (pid)*/
 pid_t exec(const char* cmd_line) {
-  pid_t pid = process_execute(cmd_line);
+  char* kcmd_line = copy_in_string(cmd_line);
+  if (kcmd_line == NULL) return -1;
 
+  pid_t pid = wait_for_load(process_execute(kcmd_line));
+  palloc_free_page(kcmd_line);
+  return pid;
+}
+
+/*Creates a copy of the current process that resumes from this syscall.
+ * Returns the child's pid in the parent and 0 in the child, or -1 if the
+ * address space could not be duplicated*/
+pid_t fork_(struct intr_frame* f) {
+  return wait_for_load(process_fork(f));
+}
+
+/*Waits until the new child PID has finished loading and returns its pid,
+ * or -1 if it failed to start*/
+static pid_t wait_for_load(pid_t pid) {
   if (pid == TID_ERROR) return -1;
 
   struct thread* cur = thread_current();
@@ -255,45 +394,73 @@ int wait(pid_t pid) {
 }
 
 /*Returns number of bytes read into the buffer.
- * If the pointers are invalid, it exits with status -1
+ * Data is read into a kernel page and copied out a page at a time. A read of
+ * a file holds the file's inode lock for the whole call, so that it sees no
+ * write to the file half done. If the buffer cannot be written, exits with
+ * status -1
  * If FD is invalid or corresponds to NULL, returns -1
  * If trying to read from STDOUT, exits with status -1
  * If trying to read from STDIN, waits for input
- * If trying to read from pipe buffer, calls pipe_read API
+ * If trying to read from pipe buffer, calls pipe_read API, which returns
+ * at most what is already in the pipe
  * Else reads from a normal file*/
 int read(int fd, const void *buffer, unsigned size)
 {
-	if(!validate_pointer(buffer))
-	  exit_(-1);
-
 	if (fd < 0 || fd > 63) return -1;
 
   struct thread* cur = thread_current();
 
   if (fd == 1) exit_(-1);
 
-  if (fd == 0 && cur->fdt[fd] == NULL) {
-    lock_acquire(&filesys_lock);
-    input_getc();
-    lock_release(&filesys_lock);
-    return size;
+  struct file_descriptor* file_desc = cur->fdt[fd];
+  if (fd != 0 || file_desc != NULL) {
+    if (file_desc == NULL || (file_desc->type != FILE && file_desc->type != PIPE_READER))
+      return -1;
   }
 
-  struct file_descriptor* file_desc = cur->fdt[fd];
-  if (file_desc == NULL) return -1;
+  char* kbuf = palloc_get_page(0);
+  if (kbuf == NULL) return -1;
 
-  int result = 0;
-  if (file_desc->type == FILE) {
-    lock_acquire(&filesys_lock);
-    result = file_read(file_desc->file, buffer, size);
-    lock_release(&filesys_lock);
+  struct inode* inode = NULL;
+  if (file_desc != NULL && file_desc->type == FILE) {
+    inode = file_get_inode(file_desc->file);
+    inode_lock(inode);
   }
-  else if (file_desc->type == PIPE_READER)
-    result = pipe_read(file_desc->pipe, buffer, size);
-  else
-    result = -1;
 
-  return result;
+  unsigned done = 0;
+  while (done < size) {
+    unsigned chunk = size - done < PGSIZE ? size - done : PGSIZE;
+
+    int result;
+    if (file_desc == NULL) {
+      for (unsigned i = 0; i < chunk; i++)
+        kbuf[i] = input_getc();
+      result = chunk;
+    }
+    else if (file_desc->type == FILE) {
+      result = file_read(file_desc->file, kbuf, chunk);
+    }
+    else
+      result = pipe_read(file_desc->pipe, kbuf, chunk);
+
+    if (result < 0) {
+      palloc_free_page(kbuf);
+      return done > 0 ? (int) done : -1;
+    }
+    if (!copy_to_user((void*) buffer + done, kbuf, result)) {
+      if (inode != NULL) inode_unlock(inode);
+      palloc_free_page(kbuf);
+      exit_(-1);
+    }
+    done += result;
+
+    // A pipe read does not wait for more than it first finds
+    if ((unsigned) result < chunk || (file_desc != NULL && file_desc->type == PIPE_READER))
+      break;
+  }
+  if (inode != NULL) inode_unlock(inode);
+  palloc_free_page(kbuf);
+  return done;
 }
 /*Returns current offset position from a given FD if the file exists, if the 
  * input is invalid or the corresponding FD is empty, it returns -1*/
@@ -304,9 +471,7 @@ unsigned int tell(int fd)
 	struct file_descriptor* file_desc = thread_current()->fdt[fd];
 	if(file_desc == NULL || file_desc->type != FILE) return -1;
 
-	lock_acquire(&filesys_lock);
 	unsigned pos = file_tell(file_desc->file);
-	lock_release(&filesys_lock);
 	return pos;
 }
 /*Returns the size of the given file in the file descriptor, returns -1 if given
@@ -318,9 +483,7 @@ int filesize(int fd)
 	struct file_descriptor* file_desc = thread_current()->fdt[fd];
 
   if(file_desc == NULL || file_desc->type != FILE) return -1;
-  lock_acquire(&filesys_lock);
   int size = file_length(file_desc->file);
-  lock_release(&filesys_lock);
 	return size;
 }
 /*Moves current file pointer to given position, if position is larger than
@@ -332,65 +495,78 @@ void seek(int fd, unsigned position)
 	struct file_descriptor* file_desc = thread_current()->fdt[fd];
 
 	if(file_desc == NULL || file_desc->type != FILE) return;
-  lock_acquire(&filesys_lock);
 	file_seek(file_desc->file, position);
-  lock_release(&filesys_lock);
 }
 /*Creates a new file in the file system directory and exits in case of invalid
  * pointer*/
 bool create(const char* file, unsigned initial_size)
 {
-	if(!validate_pointer(file))
-		exit_(-1); //Malicious pointer
+	char* name = copy_in_string(file);
+	if(name == NULL)
+		return false;
 
-	lock_acquire(&filesys_lock);
-	bool created = filesys_create(file, initial_size);
-	lock_release(&filesys_lock);
+	bool created = filesys_create(name, initial_size);
 
+	palloc_free_page(name);
 	return created;
 }
 /*Removes a given file from the file system directory and exits
  * with status -1 in case of invalid pointer*/
 bool remove(const char* file)
 {
-	if(!validate_pointer(file))
-		exit_(-1);
-	lock_acquire(&filesys_lock);
-	bool removed = filesys_remove(file);
-	lock_release(&filesys_lock);
+	char* name = copy_in_string(file);
+	if(name == NULL)
+		return false;
+	bool removed = filesys_remove(name);
+	palloc_free_page(name);
 	return removed;
 }
 
-/*Opens a file and returns its FD (between 2 and 63 as 0 and 1 are reserved
- * for STDIN and STDOUT respectively), return -1 when FDT is full and exits
- * in case of invalid pointer*/
+/*Opens a file or directory and returns its FD (between 2 and 63 as 0 and 1
+ * are reserved for STDIN and STDOUT respectively), return -1 when FDT is full
+ * and exits in case of invalid pointer*/
 int open(const char* file)
 {
-	if(!validate_pointer(file))
-		exit_(-1);
+	char* name = copy_in_string(file);
+	if(name == NULL)
+		return -1;
 	
 	struct thread* cur = thread_current();
 	int next_fd = get_next_fd();
 
-	if(next_fd == -1) // FDT is full
+	if(next_fd == -1) { // FDT is full
+	  palloc_free_page(name);
 	  return -1;
-
-	lock_acquire(&filesys_lock);
-	struct file* file_ = filesys_open(file);
-	lock_release(&filesys_lock);
-
-	if(file_ == NULL)
+	}
+
+	struct file* file_ = filesys_open(name);
+	struct dir* dir = NULL;
+	if (file_ != NULL && inode_is_dir(file_get_inode(file_))) {
+	  // Directories are read with readdir, not through a file
+	  dir = dir_open(inode_reopen(file_get_inode(file_)));
+	  file_close(file_);
+	  file_ = NULL;
+	}
+	palloc_free_page(name);
+
+	if(file_ == NULL && dir == NULL)
 		return -1;
 
-	cur->fdt[next_fd] = malloc(sizeof(struct file_descriptor));
-  cur->fdt[next_fd]->type = FILE;
+	cur->fdt[next_fd] = fd_alloc();
+  if(cur->fdt[next_fd] == NULL) {
+    file_close(file_);
+    dir_close(dir);
+    return -1;
+  }
+  cur->fdt[next_fd]->type = dir != NULL ? DIRECTORY : FILE;
   cur->fdt[next_fd]->file = file_;
   cur->fdt[next_fd]->pipe = NULL;
+  cur->fdt[next_fd]->dir = dir;
 
   return next_fd;	
 }
 
-/*Closes the given file descriptor (file or pipe) and exits wiht -1 in case of
+/*Closes the given file descriptor (file, directory or pipe) and exits wiht -1 in case of
  * wrong input or attempting to close STDIN or STDOUT*/
 void close(int fd)
 {
@@ -405,14 +581,15 @@ void close(int fd)
   
   struct file_descriptor* file_desc = cur->fdt[fd];
 
-  lock_acquire(&filesys_lock);
   if (file_desc->type == FILE)
     file_close(file_desc->file);
+  else if (file_desc->type == DIRECTORY)
+    dir_close(file_desc->dir);
   else if (file_desc->type == PIPE_READER)
     pipe_close_reader(file_desc->pipe);
   else if (file_desc->type == PIPE_WRITER)
     pipe_close_writer(file_desc->pipe);
-  lock_release(&filesys_lock);
+  slab_free(file_desc);
   cur->fdt[fd] = NULL;
 }
 
@@ -421,9 +598,6 @@ void close(int fd)
  * and the second fds[1] is the pipe write file descriptor*/
 int pipe(int* fds)
 {
-	if(!validate_pointer(fds))
-		exit_(-1);
-
 	struct thread* cur = thread_current();
 	
   int reader_fd = get_next_fd();
@@ -436,23 +610,247 @@ int pipe(int* fds)
     return -1;
   }
 
-  fds[0] = reader_fd;
-  fds[1] = writer_fd;
-
-  struct pipe* pipe = malloc(sizeof(struct pipe));
-  pipe_init(pipe);
+  struct pipe* pipe = pipe_create();
+	struct file_descriptor* reader = fd_alloc();
+	struct file_descriptor* writer = fd_alloc();
+  if (pipe == NULL || reader == NULL || writer == NULL) {
+    if (pipe != NULL) {
+      pipe_close_reader(pipe);
+      pipe_close_writer(pipe);
+    }
+    slab_free(reader);
+    slab_free(writer);
+    cur->fdt[reader_fd] = NULL;
+    return -1;
+  }
 
-	struct file_descriptor* reader = malloc(sizeof(struct file_descriptor));
   reader->type = PIPE_READER;
   reader->pipe = pipe;
   reader->file = NULL;
   cur->fdt[reader_fd] = reader;
 
-  struct file_descriptor* writer = malloc(sizeof(struct file_descriptor));
   writer->type = PIPE_WRITER;
   writer->pipe = pipe;
   writer->file = NULL;
   cur->fdt[writer_fd] = writer;
 
+  // The new descriptors are closed by thread_exit() if FDS is bad
+  int kfds[2] = { reader_fd, writer_fd };
+  if (!copy_to_user(fds, kfds, sizeof kfds))
+    exit_(-1);
+	return 0;
+}
+
+/*Copies the fault and working set statistics of the current process to
+ * MS, and exits with status -1 if MS cannot be written*/
+void memstat(struct memstat* ms)
+{
+  struct memstat kms;
+  vm_get_memstat(&kms);
+  if (!copy_to_user(ms, &kms, sizeof kms))
+    exit_(-1);
+}
+
+/*Maps the file open as FD into consecutive pages starting at ADDR and
+ * returns its mapping id. Pages are loaded lazily on first access. Returns
+ * -1 if FD is not an open file, the file is empty, ADDR is not page aligned
+ * or the range overlaps pages that are already in use*/
+mapid_t mmap(int fd, void* addr)
+{
+	if(fd < 2 || fd > 63)
+		return -1;
+	if(addr == NULL || pg_ofs(addr) != 0 || !is_user_vaddr(addr))
+		return -1;
+
+	struct thread* cur = thread_current();
+	struct file_descriptor* file_desc = cur->fdt[fd];
+	if(file_desc == NULL || file_desc->type != FILE)
+		return -1;
+
+	// Reopen so the mapping stays valid after FD is closed
+	struct file* file = file_reopen(file_desc->file);
+	off_t length = file == NULL ? 0 : file_length(file);
+	if(length == 0)
+	{
+		file_close(file);
+		return -1;
+	}
+
+	for(off_t ofs = 0; ofs < length; ofs += PGSIZE)
+		if(!is_user_vaddr(addr + ofs) || vm_entry_find(addr + ofs) != NULL)
+		{
+			file_close(file);
+			return -1;
+		}
+
+	struct mmap_file* mmap_file = malloc(sizeof(struct mmap_file));
+	if(mmap_file == NULL)
+	{
+		file_close(file);
+		return -1;
+	}
+	mmap_file->mapid = cur->next_mapid++;
+	mmap_file->file = file;
+	list_init(&mmap_file->vme_list);
+	list_push_back(&cur->mmap_list, &mmap_file->elem);
+
+	lock_acquire(&cur->vm_lock);
+	for(off_t ofs = 0; ofs < length; ofs += PGSIZE)
+	{
+		uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+		struct vm_entry* vme = vm_entry_init(addr + ofs, PAGE_FILE, true, file, ofs, read_bytes, PGSIZE - read_bytes);
+		if(vme == NULL)
+		{
+			do_munmap(mmap_file);
+			lock_release(&cur->vm_lock);
+			return -1;
+		}
+		list_push_back(&mmap_file->vme_list, &vme->mmap_elem);
+	}
+	lock_release(&cur->vm_lock);
+	return mmap_file->mapid;
+}
+
+/*Unmaps the mapping MAPID of the current process, writing back only the
+ * pages that were modified. Does nothing if there is no such mapping*/
+void munmap(mapid_t mapid)
+{
+	struct thread* cur = thread_current();
+	for(struct list_elem* e = list_begin(&cur->mmap_list); e != list_end(&cur->mmap_list); e = list_next(e))
+	{
+		struct mmap_file* mmap_file = list_entry(e, struct mmap_file, elem);
+		if(mmap_file->mapid == mapid)
+		{
+			lock_acquire(&cur->vm_lock);
+			do_munmap(mmap_file);
+			lock_release(&cur->vm_lock);
+			return;
+		}
+	}
+}
+
+/*Applies ADVICE, one of the MADV_* values, to the pages from ADDR up to
+ * ADDR + LENGTH. MADV_NORMAL, MADV_SEQUENTIAL and MADV_RANDOM are kept
+ * with each page to steer read-ahead. MADV_WILLNEED has the pages loaded
+ * in the background, and MADV_DONTNEED gives up the frames of those that
+ * can be read back unchanged. Returns 0 on success, or -1 if ADDR is not
+ * page aligned, ADVICE is unknown, or the range has unmapped pages*/
+int madvise(void* addr, size_t length, int advice)
+{
+	struct thread* cur = thread_current();
+	size_t page_cnt = DIV_ROUND_UP(length, PGSIZE);
+
+	if(pg_ofs(addr) != 0 || advice < MADV_NORMAL || advice > MADV_DONTNEED)
+		return -1;
+	if(length == 0)
+		return 0;
+	if((uintptr_t) addr + length < (uintptr_t) addr || !is_user_vaddr(addr + length - 1))
+		return -1;
+
+	lock_acquire(&cur->vm_lock);
+	for(size_t i = 0; i < page_cnt; ++i)
+		if(vm_entry_find(addr + i * PGSIZE) == NULL)
+		{
+			lock_release(&cur->vm_lock);
+			return -1;
+		}
+
+	for(size_t i = 0; i < page_cnt; ++i)
+	{
+		struct vm_entry* vme = vm_entry_find(addr + i * PGSIZE);
+		if(advice == MADV_DONTNEED)
+			page_drop_clean(vme);
+		else if(advice != MADV_WILLNEED)
+			vme->advice = advice;
+	}
+	lock_release(&cur->vm_lock);
+
+	if(advice == MADV_WILLNEED && page_cnt > 0 && !prefetch_request(addr, page_cnt))
+		return -1;
 	return 0;
 }
+
+/*Changes the current working directory of the process to DIR, relative or
+ * absolute. Returns true if successful*/
+bool chdir(const char* dir)
+{
+	char* name = copy_in_string(dir);
+	if(name == NULL)
+		return false;
+	bool changed = filesys_chdir(name);
+	palloc_free_page(name);
+	return changed;
+}
+
+/*Creates the directory DIR, relative or absolute. Returns false if it
+ * already exists or a directory on the way to it does not*/
+bool mkdir(const char* dir)
+{
+	char* name = copy_in_string(dir);
+	if(name == NULL)
+		return false;
+	bool created = filesys_mkdir(name);
+	palloc_free_page(name);
+	return created;
+}
+
+/*Reads the next entry of directory FD into NAME, which must have room for
+ * READDIR_MAX_LEN + 1 bytes. Returns false if FD is not a directory or has no
+ * entries left, other than "." and ".."*/
+bool readdir(int fd, char* name)
+{
+	if(fd < 0 || fd > 63)
+		return false;
+	struct file_descriptor* file_desc = thread_current()->fdt[fd];
+	if(file_desc == NULL || file_desc->type != DIRECTORY)
+		return false;
+
+	char kname[NAME_MAX + 1];
+	bool found = dir_readdir(file_desc->dir, kname);
+	if(found && !copy_to_user(name, kname, strlen(kname) + 1))
+		exit_(-1);
+	return found;
+}
+
+/*Returns true if FD is an open directory*/
+bool isdir(int fd)
+{
+	if(fd < 0 || fd > 63)
+		return false;
+	struct file_descriptor* file_desc = thread_current()->fdt[fd];
+	return file_desc != NULL && file_desc->type == DIRECTORY;
+}
+
+/*Returns the inode number of the file or directory open as FD, or -1 if FD
+ * is neither*/
+int inumber(int fd)
+{
+	if(fd < 0 || fd > 63)
+		return -1;
+	struct file_descriptor* file_desc = thread_current()->fdt[fd];
+	if(file_desc == NULL)
+		return -1;
+	if(file_desc->type == FILE)
+		return inode_get_inumber(file_get_inode(file_desc->file));
+	if(file_desc->type == DIRECTORY)
+		return inode_get_inumber(dir_get_inode(file_desc->dir));
+	return -1;
+}
+
+/*Writes the data of the file or directory open as FD to disk, along with the
+ * changes to the file system made so far. Returns false if FD is neither*/
+bool fsync(int fd)
+{
+	if(fd < 0 || fd > 63)
+		return false;
+	struct file_descriptor* file_desc = thread_current()->fdt[fd];
+	if(file_desc == NULL)
+		return false;
+	if(file_desc->type == FILE)
+		inode_sync(file_get_inode(file_desc->file));
+	else if(file_desc->type == DIRECTORY)
+		inode_sync(dir_get_inode(file_desc->dir));
+	else
+		return false;
+	return true;
+}
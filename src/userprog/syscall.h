@@ -4,13 +4,16 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Map region identifier. */
+typedef int mapid_t;
+
 void syscall_init (void);
-bool validate_pointer(const void*);
 int get_next_fd(void);
 void halt(void);
 void exit_(int);
 int write(int, const void *, unsigned);
 pid_t exec(const char*);
+pid_t fork_(struct intr_frame*);
 int wait(pid_t);
 unsigned int tell(int);
 int read(int, const void *, unsigned);
@@ -21,4 +24,14 @@ void seek(int, unsigned);
 void close(int);
 int open(const char*);
 int pipe(int*);
+mapid_t mmap(int, void*);
+void munmap(mapid_t);
+void memstat(struct memstat*);
+int madvise(void*, size_t, int);
+bool chdir(const char*);
+bool mkdir(const char*);
+bool readdir(int, char*);
+bool isdir(int);
+int inumber(int);
+bool fsync(int);
 #endif /* userprog/syscall.h */
@@ -0,0 +1,85 @@
+#include "userprog/uaccess.h"
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Access to user memory from the kernel.
+
+   Instead of walking the page table to check each user pointer
+   before it is used, the kernel just copies through it with the
+   routines in usercopy.S.  A user page that is valid but not yet
+   loaded is faulted in by page_fault() as it would be for the
+   process itself.  A fault on an address the process may not
+   touch makes page_fault() resume the copy routine at its fixup
+   code, via uaccess_fixup(), so that the copy fails instead of
+   killing the process with whatever locks the kernel holds.
+
+   Only the range check against PHYS_BASE has to be done up front,
+   because the kernel can read kernel addresses without faulting. */
+
+/* Copy loops in usercopy.S. */
+int user_copy (void *dst, const void *src, size_t size);
+int user_strncpy (char *dst, const char *src, size_t size);
+extern char usercopy_start[], usercopy_fault[];
+
+/* Returns true if the SIZE bytes starting at UADDR all lie
+   below PHYS_BASE. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+  return start <= (uintptr_t) PHYS_BASE
+         && size <= (uintptr_t) PHYS_BASE - start;
+}
+
+/* Copies SIZE bytes from user address USRC to DST.
+   Returns false if any of them cannot be read. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && user_copy (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.
+   Returns false if any of them cannot be written. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return is_user_range (udst, size) && user_copy (udst, src, size) == 0;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, which has room for SIZE bytes.  Returns the length of the
+   string, or SIZE if it does not fit, in which case DST is not
+   null-terminated.  Returns -1 if the string cannot be read. */
+int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  uintptr_t start = (uintptr_t) usrc;
+  size_t limit;
+  int len;
+
+  if (start >= (uintptr_t) PHYS_BASE)
+    return -1;
+
+  /* Stop at PHYS_BASE if the string reaches it. */
+  limit = (uintptr_t) PHYS_BASE - start;
+  len = user_strncpy (dst, usrc, size < limit ? size : limit);
+  if (len >= 0 && (size_t) len == limit && limit < size)
+    return -1;
+  return len;
+}
+
+/* Called by page_fault() for a kernel fault on a user address
+   that could not be resolved.  If F was interrupted inside one of
+   the copy routines, arranges for it to return failure and
+   returns true.  Otherwise returns false. */
+bool
+uaccess_fixup (struct intr_frame *f)
+{
+  char *eip = (char *) f->eip;
+
+  if (eip < usercopy_start || eip >= usercopy_fault)
+    return false;
+  f->eip = (void (*) (void)) usercopy_fault;
+  return true;
+}
@@ -1 +1,785 @@
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "vm/writeback.h"
+#include "userprog/pagedir.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <debug.h>
+#include <stddef.h>
+#include <string.h>
 
+/* Frames of the user pool that hold user pages, in clock order */
+static struct list frame_list;
+
+/* Protects frame_list, clock_hand and the residency state (frame,
+   is_loaded, type, swap_slot) of every vm_entry.
+   Swap and file I/O is done without holding frame_lock. A frame whose
+   page is being written out is marked busy, and whoever would change its
+   mappings waits on io_done until it is not */
+static struct lock frame_lock;
+static struct condition io_done;
+
+/* Number of frames in frame_list, of those that hold a file page written
+   since it was last written back, and of those that are busy. Protected
+   by frame_lock */
+static size_t frame_cnt;
+static size_t dirty_cnt;
+static size_t busy_cnt;
+
+/* Next frame to be considered by the clock algorithm */
+static struct list_elem *clock_hand;
+
+/* Current working set sample period, counting from 1. Protected by
+   frame_lock */
+static unsigned wss_period = 1;
+
+/* Read-only page of zeros mapped by every anonymous page that was read
+   but never written. It is not in frame_list and never evicted */
+static void *zero_frame;
+
+/* Resident read-only executable pages, keyed by inode, offset and
+   read_bytes. Entries go away with their frame. Protected by frame_lock */
+static struct hash text_cache;
+
+/* Frames are allocated and freed on every page load and eviction */
+static struct slab_cache frame_cache;
+
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+
+static void frame_ctor(void *);
+static void *get_user_page(enum palloc_flags);
+static struct frame *new_frame(void *, struct vm_entry *);
+static void detach_vme(struct frame *, struct vm_entry *);
+static void release_frame(struct frame *);
+static void set_dirty(struct frame *, bool);
+static void begin_io(struct frame *);
+static void end_io(struct frame *);
+static void wait_io(struct vm_entry *);
+static bool evict_frame(void);
+
+/*Initializes the frame table*/
+void frame_table_init(void)
+{
+	list_init(&frame_list);
+	lock_init(&frame_lock);
+	cond_init(&io_done);
+	clock_hand = NULL;
+	hash_init(&text_cache, text_hash, text_less, NULL);
+	slab_cache_init(&frame_cache, "frame", sizeof(struct frame), frame_ctor);
+	zero_frame = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+}
+
+/*Allocates a user frame for VME, evicting another page if the user pool
+ * is exhausted. The returned frame is pinned, the caller unpins it once
+ * the page is installed. Returns NULL if nothing could be evicted*/
+struct frame *frame_alloc(enum palloc_flags flags, struct vm_entry *vme)
+{
+	lock_acquire(&frame_lock);
+	struct frame *f = NULL;
+	void *kaddr = get_user_page(flags);
+	if(kaddr != NULL)
+	{
+		f = new_frame(kaddr, vme);
+		if(f == NULL)
+			palloc_free_page(kaddr);
+	}
+	lock_release(&frame_lock);
+	return f;
+}
+
+/*Releases VME's reference to its frame, if it has one. A dirty
+ * file-backed page is written back to its file first. The frame itself
+ * is freed once no other process maps it. If the frame is being paged
+ * out, waits for that to finish, which may leave VME in swap*/
+void frame_free(struct vm_entry *vme)
+{
+	lock_acquire(&frame_lock);
+	wait_io(vme);
+	if(vme->frame != NULL)
+	{
+		struct frame *f = vme->frame;
+		uint32_t *pd = vme->thread->pagedir;
+
+		pagedir_clear_page(pd, vme->vaddr);
+		if(vme->type == PAGE_FILE && pagedir_is_dirty(pd, vme->vaddr))
+		{
+			begin_io(f);
+			write_back_file(f->kaddr, vme);
+			end_io(f);
+			pagedir_set_dirty(pd, vme->vaddr, false);
+		}
+		detach_vme(f, vme);
+	}
+	else if(vme->is_loaded)
+	{
+		// Mapped to the zero frame, which must not be freed with the pagedir
+		pagedir_clear_page(vme->thread->pagedir, vme->vaddr);
+		vme->is_loaded = false;
+	}
+	lock_release(&frame_lock);
+}
+
+/*Waits until the frame of VME, whose page was found not present though
+ * VME is loaded, is no longer being paged out. Returns true if VME is
+ * still resident: the page was brought in by the prefetch thread, or swap
+ * had no room for it*/
+bool frame_wait_io(struct vm_entry *vme)
+{
+	lock_acquire(&frame_lock);
+	wait_io(vme);
+	bool loaded = vme->is_loaded;
+	lock_release(&frame_lock);
+	return loaded;
+}
+
+/*Maps the shared zero frame read-only at anonymous page VME, which has
+ * not been written yet. The first write gets a private frame through
+ * frame_cow(). Returns false if out of memory*/
+bool frame_map_zero(struct vm_entry *vme)
+{
+	lock_acquire(&frame_lock);
+	bool success = pagedir_set_page(vme->thread->pagedir, vme->vaddr, zero_frame, false);
+	if(success)
+		vme->is_loaded = true;
+	lock_release(&frame_lock);
+	return success;
+}
+
+/*Gives CHILD, a copy of PARENT in a forked process, the same contents as
+ * PARENT. A resident page is shared: read-only for copy-on-write, except
+ * for mmap pages which stay shared like the file they map, writable once
+ * the frame is dirty.
+ * A swapped out page shares its swap slot. A page that was never loaded
+ * stays lazy in both. Returns false if out of memory*/
+bool frame_fork(struct vm_entry *parent, struct vm_entry *child)
+{
+	bool success = true;
+
+	lock_acquire(&frame_lock);
+	wait_io(parent);
+	child->type = parent->type;
+	if(parent->frame != NULL)
+	{
+		struct frame *f = parent->frame;
+		uint32_t *parent_pd = parent->thread->pagedir;
+		uint32_t *child_pd = child->thread->pagedir;
+		bool shared_write = parent->type == PAGE_FILE && parent->is_write;
+
+		success = pagedir_set_page(child_pd, child->vaddr, f->kaddr, shared_write && f->dirty);
+		if(success)
+		{
+			if(!shared_write)
+				pagedir_set_writable(parent_pd, parent->vaddr, false);
+			// The child's copy differs from the file just as much as the parent's
+			pagedir_set_dirty(child_pd, child->vaddr, pagedir_is_dirty(parent_pd, parent->vaddr));
+			list_push_back(&f->vme_list, &child->frame_elem);
+			f->refcnt++;
+			child->frame = f;
+			child->is_loaded = true;
+		}
+	}
+	else if(parent->type == PAGE_SWAP && parent->swap_slot != (size_t) -1)
+	{
+		swap_share(parent->swap_slot);
+		child->swap_slot = parent->swap_slot;
+	}
+	lock_release(&frame_lock);
+	return success;
+}
+
+/*Handles a write to VME's read-only copy-on-write page. The last process
+ * sharing a frame simply gets it back writable, others get a private copy,
+ * and a page mapped to the zero frame gets a zeroed frame of its own.
+ * Returns false if out of memory*/
+bool frame_cow(struct vm_entry *vme)
+{
+	bool success = true;
+
+	lock_acquire(&frame_lock);
+	wait_io(vme);
+	struct frame *f = vme->frame;
+	uint32_t *pd = vme->thread->pagedir;
+
+	if(f == NULL)
+	{
+		if(vme->is_loaded)
+		{
+			void *kaddr = get_user_page(PAL_ZERO);
+			struct frame *zeroed = kaddr == NULL ? NULL : new_frame(kaddr, vme);
+			if(zeroed == NULL)
+			{
+				if(kaddr != NULL)
+					palloc_free_page(kaddr);
+				success = false;
+			}
+			else
+			{
+				pagedir_clear_page(pd, vme->vaddr);
+				success = pagedir_set_page(pd, vme->vaddr, kaddr, true);
+				zeroed->pinned = false;
+			}
+		}
+		// Otherwise evicted after the fault: the retried access will load it normally
+		lock_release(&frame_lock);
+		return success;
+	}
+
+	if(f->refcnt == 1)
+		pagedir_set_writable(pd, vme->vaddr, true);
+	else
+	{
+		bool was_pinned = f->pinned;
+		f->pinned = true; // Keep the source from being chosen as a victim
+		void *kaddr = get_user_page(0);
+		f->pinned = was_pinned;
+
+		struct frame *copy = kaddr == NULL || f->refcnt == 1 ? NULL : new_frame(kaddr, NULL);
+		if(f->refcnt == 1)
+		{
+			// The other sharers let go while eviction released frame_lock
+			if(kaddr != NULL)
+				palloc_free_page(kaddr);
+			pagedir_set_writable(pd, vme->vaddr, true);
+		}
+		else if(copy == NULL)
+		{
+			if(kaddr != NULL)
+				palloc_free_page(kaddr);
+			success = false;
+		}
+		else
+		{
+			memcpy(kaddr, f->kaddr, PGSIZE);
+			pagedir_clear_page(pd, vme->vaddr);
+			list_remove(&vme->frame_elem);
+			f->refcnt--;
+
+			list_push_back(&copy->vme_list, &vme->frame_elem);
+			copy->refcnt = 1;
+			vme->frame = copy;
+			success = pagedir_set_page(pd, vme->vaddr, kaddr, true);
+			copy->pinned = false;
+		}
+	}
+	lock_release(&frame_lock);
+	return success;
+}
+
+/*Handles the first write to mmap page VME since it was loaded or last
+ * written back, which is mapped read-only until then so that the frame
+ * table learns which frames are dirty. Makes the page writable and counts
+ * its frame dirty*/
+void frame_write_file(struct vm_entry *vme)
+{
+	lock_acquire(&frame_lock);
+	wait_io(vme);
+	// Evicted after the fault if there is no frame: the retried access loads it
+	if(vme->frame != NULL)
+	{
+		set_dirty(vme->frame, true);
+		pagedir_set_writable(vme->thread->pagedir, vme->vaddr, true);
+	}
+	lock_release(&frame_lock);
+}
+
+/*Maps the read-only executable page VME into its process from a frame
+ * that another process running the same program already loaded. Returns
+ * false if no process has it resident, the caller then loads it*/
+bool frame_share_text(struct vm_entry *vme)
+{
+	struct frame key;
+	key.inode = file_get_inode(vme->file);
+	key.ofs = vme->offset;
+	key.read_bytes = vme->read_bytes;
+
+	lock_acquire(&frame_lock);
+	struct hash_elem *e = hash_find(&text_cache, &key.text_elem);
+	bool shared = false;
+	// A busy frame is on its way out, the caller loads a copy of its own
+	if(e != NULL && !hash_entry(e, struct frame, text_elem)->busy)
+	{
+		struct frame *f = hash_entry(e, struct frame, text_elem);
+		shared = pagedir_set_page(vme->thread->pagedir, vme->vaddr, f->kaddr, false);
+		if(shared)
+		{
+			list_push_back(&f->vme_list, &vme->frame_elem);
+			f->refcnt++;
+			vme->frame = f;
+			vme->is_loaded = true;
+		}
+	}
+	lock_release(&frame_lock);
+	return shared;
+}
+
+/*Publishes F, just loaded with the read-only executable page VME, to
+ * other processes running the same program. Keeps F private if another
+ * process loaded the same page meanwhile*/
+void frame_cache_text(struct frame *f, struct vm_entry *vme)
+{
+	f->inode = file_get_inode(vme->file);
+	f->ofs = vme->offset;
+	f->read_bytes = vme->read_bytes;
+
+	lock_acquire(&frame_lock);
+	if(hash_insert(&text_cache, &f->text_elem) == NULL)
+		f->in_text_cache = true;
+	lock_release(&frame_lock);
+}
+
+/* Hashes a text cache entry by its key */
+static unsigned text_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+	const struct frame *f = hash_entry(e, struct frame, text_elem);
+	return hash_int((int) f->inode) ^ hash_int(f->ofs) ^ hash_int(f->read_bytes);
+}
+
+/* Orders text cache entries by their key */
+static bool text_less(const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED)
+{
+	const struct frame *a = hash_entry(a_, struct frame, text_elem);
+	const struct frame *b = hash_entry(b_, struct frame, text_elem);
+	if(a->inode != b->inode)
+		return a->inode < b->inode;
+	if(a->ofs != b->ofs)
+		return a->ofs < b->ofs;
+	return a->read_bytes < b->read_bytes;
+}
+
+/* Sets up the fields of a frame that are the same in every unused frame.
+   detach_vme() leaves them this way before freeing one */
+static void frame_ctor(void *p)
+{
+	struct frame *f = p;
+	list_init(&f->vme_list);
+	f->refcnt = 0;
+	f->in_text_cache = false;
+}
+
+/* Returns a page from the user pool, evicting as needed. Returns NULL
+   if every frame is pinned. Must be called with frame_lock held, which
+   eviction releases while it writes a victim out */
+static void *get_user_page(enum palloc_flags flags)
+{
+	void *kaddr = palloc_get_page(PAL_USER | flags);
+	while(kaddr == NULL && evict_frame())
+		kaddr = palloc_get_page(PAL_USER | flags);
+	return kaddr;
+}
+
+/* Puts KADDR in the frame table as a pinned frame holding VME, or no
+   page yet if VME is NULL. Must be called with frame_lock held */
+static struct frame *new_frame(void *kaddr, struct vm_entry *vme)
+{
+	struct frame *f = slab_alloc(&frame_cache);
+	if(f == NULL)
+		return NULL;
+
+	f->kaddr = kaddr;
+	f->pinned = true;
+	f->referenced = false;
+	f->writeback = false;
+	f->dirty = false;
+	f->busy = false;
+	if(vme != NULL)
+	{
+		list_push_back(&f->vme_list, &vme->frame_elem);
+		f->refcnt = 1;
+		vme->frame = f;
+	}
+	list_push_back(&frame_list, &f->lru);
+	frame_cnt++;
+	return f;
+}
+
+/* Unmaps VME from F, which its caller already wrote back if it is a dirty
+   file page, and frees F when this was the last mapping, unless the
+   writeback thread is writing it. Must be called with frame_lock held */
+static void detach_vme(struct frame *f, struct vm_entry *vme)
+{
+	pagedir_clear_page(vme->thread->pagedir, vme->vaddr);
+
+	list_remove(&vme->frame_elem);
+	vme->frame = NULL;
+	vme->is_loaded = false;
+	if(--f->refcnt > 0)
+		return;
+
+	if(clock_hand == &f->lru)
+		clock_hand = list_next(clock_hand);
+	list_remove(&f->lru);
+	frame_cnt--;
+	set_dirty(f, false);
+	if(f->in_text_cache)
+	{
+		hash_delete(&text_cache, &f->text_elem);
+		f->in_text_cache = false;
+	}
+	if(!f->writeback)
+		release_frame(f);
+}
+
+/* Marks F as holding a file page that differs from the file, or not,
+   keeping dirty_cnt up to date. Must be called with frame_lock held */
+static void set_dirty(struct frame *f, bool dirty)
+{
+	if(f->dirty != dirty)
+	{
+		f->dirty = dirty;
+		if(dirty)
+			dirty_cnt++;
+		else
+			dirty_cnt--;
+	}
+}
+
+/* Marks F busy and releases frame_lock, so that F's page can be written
+   out without blocking every other page fault. The pages mapping F must
+   already be unmapped, so that nobody modifies it meanwhile */
+static void begin_io(struct frame *f)
+{
+	f->busy = true;
+	busy_cnt++;
+	lock_release(&frame_lock);
+}
+
+/* Retakes frame_lock once the I/O begun by begin_io() is done, and wakes
+   up those waiting for F */
+static void end_io(struct frame *f)
+{
+	lock_acquire(&frame_lock);
+	f->busy = false;
+	busy_cnt--;
+	cond_broadcast(&io_done, &frame_lock);
+}
+
+/* Waits until VME's frame, if it has one, is not busy. VME may have lost
+   the frame by then. Must be called with frame_lock held */
+static void wait_io(struct vm_entry *vme)
+{
+	while(vme->frame != NULL && vme->frame->busy)
+		cond_wait(&io_done, &frame_lock);
+}
+
+/* Frees F, which is out of frame_list and maps nothing */
+static void release_frame(struct frame *f)
+{
+	palloc_free_page(f->kaddr);
+	slab_free(f);
+}
+
+/* Rolls T's working set count over to the current sample period. The
+   count of the period that just ended becomes its working set, and a
+   process that accessed nothing in it has an empty one. Must be called
+   with frame_lock held */
+static void wss_roll(struct thread *t)
+{
+	struct memstat *ms = &t->memstat;
+
+	if(t->wss_period == wss_period)
+		return;
+	if(t->wss_period != 0)
+	{
+		ms->wss_pages = t->wss_period + 1 == wss_period ? t->wss_count : 0;
+		if(ms->wss_pages > ms->peak_wss_pages)
+			ms->peak_wss_pages = ms->wss_pages;
+		ms->wss_samples += wss_period - t->wss_period;
+	}
+	t->wss_period = wss_period;
+	t->wss_count = 0;
+}
+
+/* Counts VME, whose accessed bit was found set and cleared, in the working
+   set of its process for the current period, once. Must be called with
+   frame_lock held */
+static void wss_count_access(struct vm_entry *vme)
+{
+	wss_roll(vme->thread);
+	if(vme->wss_period != wss_period)
+	{
+		vme->wss_period = wss_period;
+		vme->thread->wss_count++;
+	}
+}
+
+/*Ends the current working set sample period. The accessed bits of every
+ * page in the frame table are counted and cleared first; pages mapped to
+ * the zero frame are not counted. The clock still needs to see those
+ * accesses, so they are remembered in the frame until its next sweep*/
+void frame_sample_wss(void)
+{
+	lock_acquire(&frame_lock);
+	for(struct list_elem *e = list_begin(&frame_list); e != list_end(&frame_list); e = list_next(e))
+	{
+		struct frame *f = list_entry(e, struct frame, lru);
+		for(struct list_elem *v = list_begin(&f->vme_list); v != list_end(&f->vme_list); v = list_next(v))
+		{
+			struct vm_entry *vme = list_entry(v, struct vm_entry, frame_elem);
+			uint32_t *pd = vme->thread->pagedir;
+			if(!pagedir_is_accessed(pd, vme->vaddr))
+				continue;
+			pagedir_set_accessed(pd, vme->vaddr, false);
+			f->referenced = true;
+			wss_count_access(vme);
+		}
+	}
+	wss_period++;
+	lock_release(&frame_lock);
+}
+
+/*Brings the working set in T's memstat up to date*/
+void frame_wss_update(struct thread *t)
+{
+	lock_acquire(&frame_lock);
+	wss_roll(t);
+	lock_release(&frame_lock);
+}
+
+/*Ends the sample period of the current process early, as it exits. The
+ * pages in VM_LIST, its vm_entries, accessed so far in the period make up
+ * its last working set*/
+void frame_wss_end(struct list *vm_list)
+{
+	struct thread *cur = thread_current();
+	struct memstat *ms = &cur->memstat;
+
+	lock_acquire(&frame_lock);
+	wss_roll(cur);
+	for(struct list_elem *e = list_begin(vm_list); e != list_end(vm_list); e = list_next(e))
+	{
+		struct vm_entry *vme = list_entry(e, struct vm_entry, list_elem);
+		if(vme->frame == NULL || !pagedir_is_accessed(cur->pagedir, vme->vaddr))
+			continue;
+		pagedir_set_accessed(cur->pagedir, vme->vaddr, false);
+		vme->frame->referenced = true;
+		wss_count_access(vme);
+	}
+	ms->wss_pages = cur->wss_count;
+	if(ms->wss_pages > ms->peak_wss_pages)
+		ms->peak_wss_pages = ms->wss_pages;
+	ms->wss_samples++;
+	cur->wss_count = 0;
+	lock_release(&frame_lock);
+}
+
+/*Returns the number of frames holding dirty pages of mapped files, and
+ * stores the number of frames in *FRAMES*/
+size_t frame_count_dirty(size_t *frames)
+{
+	lock_acquire(&frame_lock);
+	size_t dirty = dirty_cnt;
+	*frames = frame_cnt;
+	lock_release(&frame_lock);
+	return dirty;
+}
+
+/*Hands up to MAX dirty pages of mapped files to the writeback thread in
+ * PAGES and returns how many. They are made clean and read-only again, so
+ * a write from now on makes them dirty again, and the frames are kept from
+ * being evicted or freed until frame_writeback_end(). The pages keep the
+ * file of their mapping, which munmap only closes after writeback_sync()*/
+size_t frame_writeback_begin(struct writeback_page *pages, size_t max)
+{
+	size_t cnt = 0;
+
+	lock_acquire(&frame_lock);
+	for(struct list_elem *e = list_begin(&frame_list); e != list_end(&frame_list) && cnt < max; e = list_next(e))
+	{
+		struct frame *f = list_entry(e, struct frame, lru);
+		if(f->pinned || f->writeback || f->busy || !f->dirty)
+			continue;
+
+		struct vm_entry *vme = NULL;
+		for(struct list_elem *v = list_begin(&f->vme_list); v != list_end(&f->vme_list); v = list_next(v))
+		{
+			vme = list_entry(v, struct vm_entry, frame_elem);
+			pagedir_set_writable(vme->thread->pagedir, vme->vaddr, false);
+			pagedir_set_dirty(vme->thread->pagedir, vme->vaddr, false);
+		}
+		set_dirty(f, false);
+		f->writeback = true;
+		pages[cnt].frame = f;
+		pages[cnt].file = vme->file;
+		pages[cnt].ofs = vme->offset;
+		pages[cnt].bytes = vme->read_bytes;
+		cnt++;
+	}
+	lock_release(&frame_lock);
+	return cnt;
+}
+
+/*Makes the CNT frames in PAGES, now written back, evictable again, and
+ * frees those that were unmapped meanwhile*/
+void frame_writeback_end(struct writeback_page *pages, size_t cnt)
+{
+	lock_acquire(&frame_lock);
+	for(size_t i = 0; i < cnt; ++i)
+	{
+		struct frame *f = pages[i].frame;
+		f->writeback = false;
+		if(f->refcnt == 0)
+			release_frame(f);
+	}
+	lock_release(&frame_lock);
+}
+
+/* Advances the clock hand, wrapping around at the end of the list */
+static struct frame *next_clock_frame(void)
+{
+	if(clock_hand == NULL || clock_hand == list_end(&frame_list))
+		clock_hand = list_begin(&frame_list);
+	struct frame *f = list_entry(clock_hand, struct frame, lru);
+	clock_hand = list_next(clock_hand);
+	return f;
+}
+
+/* Returns true if any process mapping F accessed it since the last
+   sweep, clearing the accessed bits. Each access found also counts in the
+   working set of its process, so that the clock does not hide it from the
+   next sample */
+static bool test_and_clear_accessed(struct frame *f)
+{
+	bool accessed = f->referenced;
+	f->referenced = false;
+	for(struct list_elem *e = list_begin(&f->vme_list); e != list_end(&f->vme_list); e = list_next(e))
+	{
+		struct vm_entry *vme = list_entry(e, struct vm_entry, frame_elem);
+		uint32_t *pd = vme->thread->pagedir;
+		if(pagedir_is_accessed(pd, vme->vaddr))
+		{
+			pagedir_set_accessed(pd, vme->vaddr, false);
+			wss_count_access(vme);
+			accessed = true;
+		}
+	}
+	return accessed;
+}
+
+/* Picks a victim with the clock algorithm. Dirty mmap pages are passed
+   over while there is another choice, and left to the writeback thread.
+   Returns NULL if every frame is pinned, busy or being written back */
+static struct frame *pick_victim(void)
+{
+	struct frame *victim = NULL;
+	struct frame *dirty_victim = NULL;
+
+	// Two sweeps are enough to find an unaccessed frame if one is unpinned
+	for(size_t i = 0; i < 2 * frame_cnt && victim == NULL; ++i)
+	{
+		struct frame *f = next_clock_frame();
+		if(f->pinned || f->writeback || f->busy || test_and_clear_accessed(f))
+			continue;
+		if(!f->dirty)
+			victim = f;
+		else if(dirty_victim == NULL)
+		{
+			dirty_victim = f;
+			writeback_kick();
+		}
+	}
+	return victim != NULL ? victim : dirty_victim;
+}
+
+/* Returns true if VME, a page of VICTIM that is unmapped for eviction,
+   has to go to swap */
+static bool needs_swap(struct vm_entry *vme)
+{
+	return vme->type == PAGE_ANON || vme->type == PAGE_SWAP
+	       || (vme->type == PAGE_ELF && pagedir_is_dirty(vme->thread->pagedir, vme->vaddr));
+}
+
+/* Pages VICTIM out of every process that maps it. Clean pages backed by a
+   file are dropped, dirty mmap pages are written back to their file, and
+   everything else goes to swap, in one slot shared by every process that
+   needs it. The writes are done with frame_lock released and VICTIM busy,
+   which keeps its vme_list from changing. Returns false, leaving VICTIM
+   mapped, if swap has no room. Must be called with frame_lock held */
+static bool page_out(struct frame *victim)
+{
+	struct list_elem *e;
+	bool swap = false;
+
+	// Unmap first so no owner can modify the page while it is written out
+	for(e = list_begin(&victim->vme_list); e != list_end(&victim->vme_list); e = list_next(e))
+	{
+		struct vm_entry *vme = list_entry(e, struct vm_entry, frame_elem);
+		pagedir_clear_page(vme->thread->pagedir, vme->vaddr);
+		swap = swap || needs_swap(vme);
+	}
+
+	begin_io(victim);
+	size_t slot = SWAP_ERROR;
+	if(swap)
+		slot = swap_out(victim->kaddr);
+	if(!swap || slot != SWAP_ERROR)
+		for(e = list_begin(&victim->vme_list); e != list_end(&victim->vme_list); e = list_next(e))
+		{
+			struct vm_entry *vme = list_entry(e, struct vm_entry, frame_elem);
+			if(vme->type == PAGE_FILE && pagedir_is_dirty(vme->thread->pagedir, vme->vaddr))
+				write_back_file(victim->kaddr, vme);
+		}
+	end_io(victim);
+
+	if(swap && slot == SWAP_ERROR)
+	{
+		for(e = list_begin(&victim->vme_list); e != list_end(&victim->vme_list); e = list_next(e))
+		{
+			struct vm_entry *vme = list_entry(e, struct vm_entry, frame_elem);
+			pagedir_restore_page(vme->thread->pagedir, vme->vaddr);
+		}
+		return false;
+	}
+
+	// The reference swap_out() returned goes to the first sharer
+	bool slot_taken = false;
+
+	// The last detach frees VICTIM, so count down instead of testing its list
+	for(int sharers = victim->refcnt; sharers > 0; --sharers)
+	{
+		struct vm_entry *vme = list_entry(list_front(&victim->vme_list), struct vm_entry, frame_elem);
+
+		if(needs_swap(vme))
+		{
+			if(slot_taken)
+				swap_share(slot);
+			slot_taken = true;
+			vme->swap_slot = slot;
+			vme->type = PAGE_SWAP;
+		}
+
+		// Already written back, so a later write must make it dirty again
+		pagedir_set_dirty(vme->thread->pagedir, vme->vaddr, false);
+		detach_vme(victim, vme);
+	}
+	return true;
+}
+
+/*Evicts a page, in the order of the clock algorithm. A victim that swap
+ * has no room for stays, marked referenced so that the clock moves on
+ * from it, and another is tried. If no frame can be a victim only
+ * because others are being paged out, waits for one of those instead.
+ * Must be called with frame_lock held, which is released meanwhile.
+ * Returns false if every frame is pinned, being written back, or cannot
+ * be swapped out*/
+static bool evict_frame(void)
+{
+	for(size_t tries = 0; tries < frame_cnt; ++tries)
+	{
+		struct frame *victim = pick_victim();
+		if(victim == NULL)
+		{
+			if(busy_cnt == 0)
+				return false;
+			// A busy frame is freed or becomes evictable again
+			cond_wait(&io_done, &frame_lock);
+			return true;
+		}
+		if(page_out(victim))
+			return true;
+		victim->referenced = true;
+	}
+	return false;
+}
@@ -0,0 +1,77 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "lib/kernel/list.h"
+#include "lib/kernel/hash.h"
+#include "filesys/off_t.h"
+#include "vm/page.h"
+#include <stdbool.h>
+
+/* A physical frame from the user pool holding one user page. The frame
+   may be shared by several vm_entries after fork, or between processes
+   running the same executable */
+struct frame{
+	void *kaddr; // Kernel virtual address of the frame
+	struct list vme_list; // vm_entries mapping this frame
+	int refcnt; // Number of entries in vme_list
+	bool pinned; // Frames being filled are not eligible for eviction
+	bool referenced; // Accessed bit was cleared by a working set sample
+	bool writeback; // Being written back, freed by the writeback thread if
+	                // unmapped meanwhile
+	bool dirty; // Holds a file page written since it was last written back
+	bool busy; // Being written to swap or to its file without frame_lock, so
+	           // that its mappings must not change
+	struct list_elem lru; // Element in the clock list
+
+	/* Read-only executable pages are also found by the file data they
+	   hold, so that processes running the same program share them */
+	bool in_text_cache; // True while text_elem is in the text cache
+	struct hash_elem text_elem;
+	struct inode *inode; // Key: inode of the executable
+	off_t ofs; // Key: offset of the page in the file
+	uint32_t read_bytes; // Key: bytes read from the file, the rest is zero
+};
+
+/* A dirty file page handed to the writeback thread */
+struct writeback_page{
+	struct frame *frame;
+	struct file *file; // The mapping's, open until writeback_sync() returns
+	off_t ofs;
+	uint32_t bytes;
+};
+
+void frame_table_init(void);
+
+struct frame *frame_alloc(enum palloc_flags, struct vm_entry *);
+
+void frame_free(struct vm_entry *);
+
+bool frame_wait_io(struct vm_entry *);
+
+bool frame_fork(struct vm_entry *, struct vm_entry *);
+
+bool frame_cow(struct vm_entry *);
+
+void frame_write_file(struct vm_entry *);
+
+bool frame_map_zero(struct vm_entry *);
+
+bool frame_share_text(struct vm_entry *);
+
+void frame_cache_text(struct frame *, struct vm_entry *);
+
+void frame_sample_wss(void);
+
+void frame_wss_update(struct thread *);
+
+void frame_wss_end(struct list *);
+
+size_t frame_count_dirty(size_t *);
+
+size_t frame_writeback_begin(struct writeback_page *, size_t);
+
+void frame_writeback_end(struct writeback_page *, size_t);
+
+#endif /* VM_FRAME_H */
@@ -1,15 +1,39 @@
+
 #include "userprog/pagedir.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "lib/kernel/list.h"
 #include "filesys/file.h"
 #include "page.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "vm/writeback.h"
+#include "devices/timer.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+
+/* One vm_entry exists for every page of every process */
+static struct slab_cache vme_cache;
+
+/* Ticks between two working set samples of a process */
+#define WSS_INTERVAL TIMER_FREQ
+
+/* -vmstats: Print the memory statistics of each process when it exits */
+bool vm_report_stats;
+
+/*Initializes the cache that vm_entries are allocated from*/
+void vm_entry_cache_init(void)
+{
+	slab_cache_init(&vme_cache, "vm_entry", sizeof(struct vm_entry), NULL);
+}
+
 struct vm_entry * vm_entry_init(void *vaddr, enum page_type type, bool writeable,struct file *file, unsigned offset, uint32_t read_bytes, uint32_t zero_bytes)
 {
-        struct vm_entry* vme = malloc(sizeof(struct vm_entry));
+        struct vm_entry* vme = slab_alloc(&vme_cache);
 
         if(vme == NULL)
                 return NULL;
@@ -19,6 +43,11 @@ struct vm_entry * vm_entry_init(void *vaddr, enum page_type type, bool writeable
         vme -> type = type;
         vme -> swap_slot = -1; // Still not allocated in swap slot
         vme -> is_write = writeable;
+        vme -> is_loaded = false;
+        vme -> advice = MADV_NORMAL;
+        vme -> wss_period = 0;
+        vme -> thread = cur;
+        vme -> frame = NULL;
         vme -> file = file;
         vme -> offset = offset;
         vme -> read_bytes = read_bytes;
@@ -28,9 +57,15 @@ struct vm_entry * vm_entry_init(void *vaddr, enum page_type type, bool writeable
 }
 
 struct vm_entry *vm_entry_find(void *vaddr) {
+    return vm_entry_find_in(thread_current(), vaddr);
+}
+
+/* Returns the vm_entry of thread T for the page containing VADDR, or NULL.
+   T's vm_lock must be held unless T is the current thread */
+struct vm_entry *vm_entry_find_in(struct thread *t, void *vaddr) {
     struct list_elem *e;
     void* page_addr = pg_round_down(vaddr);
-    struct list *vm_list = &thread_current()->vm_list;
+    struct list *vm_list = &t->vm_list;
     for (e = list_begin(vm_list); e != list_end(vm_list); e = list_next(e)) {
         struct vm_entry *vme = list_entry(e, struct vm_entry, list_elem);
         if (vme->vaddr == page_addr) {
@@ -39,6 +74,16 @@ struct vm_entry *vm_entry_find(void *vaddr) {
     }
     return NULL;
 }
+
+/* Releases the frame and swap slot held by VME and frees it.
+   VME must already be removed from its lists. */
+void free_vm_entry(struct vm_entry *vme) {
+    frame_free(vme);
+    if (vme->type == PAGE_SWAP && vme->swap_slot != (size_t) -1)
+        swap_free(vme->swap_slot);
+    slab_free(vme);
+}
+
 void free_vm_list(struct list *vm_list) {
     if(vm_list == NULL)
 	    return;
@@ -47,22 +92,110 @@ void free_vm_list(struct list *vm_list) {
     while (!list_empty(vm_list)){
         e = list_pop_front(vm_list);
         struct vm_entry *vme = list_entry(e, struct vm_entry, list_elem);
-	pagedir_clear_page(thread_current()->pagedir, vme->vaddr);
-	free(vme);
+	free_vm_entry(vme);
     }
-  
+
 }
 
+/* Reads the file-backed part of VME's page into KADDR and zeroes the rest.
+   Takes no lock of its own: file_read_at() holds the inode's rw semaphore,
+   which orders it with read and write system calls on the same file. */
 bool load_file(void *kaddr, struct vm_entry * vme)
 {
-	if(vme->read_bytes == 0)
-		return true;
-
-	file_seek(vme->file, vme->offset);
-        off_t read_bytes = file_read(vme->file, kaddr, vme->read_bytes);
-        if(read_bytes != vme->read_bytes)
-                return false;
+	if(vme->read_bytes > 0)
+	{
+		off_t read_bytes = file_read_at(vme->file, kaddr, vme->read_bytes, vme->offset);
+		if(read_bytes != (off_t) vme->read_bytes)
+			return false;
+	}
 
         memset(kaddr + vme->read_bytes, 0, vme->zero_bytes);
         return true;
 }
+
+/* Writes the file-backed part of the page at KADDR back to VME's file.
+   Only called for pages whose dirty bit is set. Like load_file(), relies on
+   the locking that file_write_at() does. */
+void write_back_file(void *kaddr, struct vm_entry *vme)
+{
+	file_write_at(vme->file, kaddr, vme->read_bytes, vme->offset);
+}
+
+/* Unmaps every page of MMAP_FILE, writing dirty pages back, and
+   closes its file. Returns once pages handed to the writeback thread
+   are written too. */
+void do_munmap(struct mmap_file *mmap_file)
+{
+	while(!list_empty(&mmap_file->vme_list))
+	{
+		struct list_elem *e = list_pop_front(&mmap_file->vme_list);
+		struct vm_entry *vme = list_entry(e, struct vm_entry, mmap_elem);
+		list_remove(&vme->list_elem);
+		free_vm_entry(vme);
+	}
+	writeback_sync();
+	list_remove(&mmap_file->elem);
+	file_close(mmap_file->file);
+	free(mmap_file);
+}
+
+/* Gives up the frame of VME if the page can be loaded again unchanged:
+   a page mapped to the zero frame, or a file or executable page that was
+   not written. The vm_lock of VME's process must be held */
+void page_drop_clean(struct vm_entry *vme)
+{
+	if(!vme->is_loaded)
+		return;
+	if(vme->frame != NULL
+	   && (vme->type == PAGE_ANON || vme->type == PAGE_SWAP
+	       || pagedir_is_dirty(vme->thread->pagedir, vme->vaddr)))
+		return;
+	frame_free(vme);
+}
+
+/* Ends a working set sample period every WSS_INTERVAL ticks, whether or
+   not the processes enter the kernel */
+static void wss_thread(void *aux UNUSED)
+{
+	for(;;)
+	{
+		timer_sleep(WSS_INTERVAL);
+		frame_sample_wss();
+	}
+}
+
+/*Starts sampling the working sets of processes*/
+void vm_wss_init(void)
+{
+	thread_create("wss", PRI_DEFAULT, wss_thread, NULL);
+}
+
+/* Stores the memory statistics of the current process in MS */
+void vm_get_memstat(struct memstat *ms)
+{
+	struct thread *cur = thread_current();
+	struct list_elem *e;
+
+	frame_wss_update(cur);
+	*ms = cur->memstat;
+	ms->resident_pages = 0;
+	for(e = list_begin(&cur->vm_list); e != list_end(&cur->vm_list); e = list_next(e))
+		if(list_entry(e, struct vm_entry, list_elem)->is_loaded)
+			ms->resident_pages++;
+}
+
+/* Prints the memory statistics of the current process, which is exiting,
+   if the -vmstats option was given. The last sample period is cut short */
+void vm_print_memstat(void)
+{
+	struct memstat ms;
+
+	if(!vm_report_stats)
+		return;
+	frame_wss_end(&thread_current()->vm_list);
+	vm_get_memstat(&ms);
+	printf("%s: %u minor faults, %u major faults, %u resident pages, "
+	       "working set %u pages (peak %u, %u samples)\n",
+	       thread_name(), ms.minor_faults, ms.major_faults, ms.resident_pages,
+	       ms.wss_pages, ms.peak_wss_pages, ms.wss_samples);
+}
@@ -6,8 +6,10 @@
 #include "threads/thread.h"
 #include "lib/kernel/list.h"
 #include "filesys/file.h"
+#include <madvise.h>
 #include <stdbool.h>
 
+struct frame;
 
 enum page_type{
 	PAGE_FILE, PAGE_SWAP, PAGE_ELF, PAGE_ANON
@@ -15,23 +17,59 @@ enum page_type{
 
 struct vm_entry{
 	struct list_elem list_elem;
-        enum page_type type; 
+	struct list_elem mmap_elem; // Element in the owning mmap_file's vme_list
+	struct list_elem frame_elem; // Element in the frame's vme_list while loaded
+	struct thread *thread; // Owner of the page
+	struct frame *frame; // Frame holding the page, NULL if not loaded or
+	                     // if loaded as the shared zero frame
+        enum page_type type;
 	bool is_write;
+	bool is_loaded; // True while the page is resident in a frame
+	uint8_t advice; // MADV_NORMAL, MADV_SEQUENTIAL or MADV_RANDOM
+	unsigned wss_period; // Last working set sample period that counted
+	                     // the page, 0 if none
 	size_t swap_slot;
 	void* vaddr; // The address of the page, and the VPN is found from it
 	struct file *file;
 	int offset;
 	uint32_t read_bytes;
-	uint32_t zero_bytes
+	uint32_t zero_bytes;
 };
 
+/* A file mapped into memory by the mmap syscall */
+struct mmap_file{
+	int mapid;
+	struct file *file; // Reopened so that closing the fd keeps the mapping
+	struct list_elem elem; // Element in thread's mmap_list
+	struct list vme_list; // vm_entries of the pages of this mapping
+};
+
+extern bool vm_report_stats;
+
+void vm_entry_cache_init(void);
+
 struct vm_entry * vm_entry_init(void *, enum page_type, bool,struct file *, unsigned, uint32_t, uint32_t);
 
 struct vm_entry *vm_entry_find(void*);
 
+struct vm_entry *vm_entry_find_in(struct thread *, void *);
+
+void free_vm_entry(struct vm_entry *);
+
 void free_vm_list(struct list *);
 
 bool load_file(void *, struct vm_entry *);
 
-#endif /* VM_PAGE_H */
+void write_back_file(void *, struct vm_entry *);
 
+void do_munmap(struct mmap_file *);
+
+void page_drop_clean(struct vm_entry *);
+
+void vm_wss_init(void);
+
+void vm_get_memstat(struct memstat *);
+
+void vm_print_memstat(void);
+
+#endif /* VM_PAGE_H */
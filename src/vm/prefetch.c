@@ -0,0 +1,132 @@
+#include "vm/prefetch.h"
+#include "vm/page.h"
+#include "userprog/process.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <debug.h>
+
+/* Pages that a process asked to have loaded with MADV_WILLNEED. The
+   prefetch thread loads them in the background while the process keeps
+   running, taking the process's vm_lock one page at a time just as a
+   page fault would */
+struct prefetch_req{
+	struct list_elem elem;
+	struct thread *thread; // Process whose pages are loaded
+	void *start; // First page
+	size_t page_cnt;
+	bool cancelled; // Set when the process exits while this is running
+};
+
+/* Pending requests, oldest first */
+static struct list queue;
+
+/* Protects queue and busy, and is the lock of both conditions */
+static struct lock queue_lock;
+
+/* Signaled when a request is queued */
+static struct condition queue_cond;
+
+/* Signaled when the prefetch thread finishes a request */
+static struct condition done_cond;
+
+/* Request being worked on by the prefetch thread, or NULL */
+static struct prefetch_req *busy;
+
+static thread_func prefetch_thread;
+static void prefetch_pages(struct prefetch_req *);
+
+/*Initializes the request queue and starts the prefetch thread*/
+void prefetch_init(void)
+{
+	list_init(&queue);
+	lock_init(&queue_lock);
+	cond_init(&queue_cond);
+	cond_init(&done_cond);
+	busy = NULL;
+	thread_create("prefetch", PRI_DEFAULT, prefetch_thread, NULL);
+}
+
+/*Asks for the PAGE_CNT pages of the current process starting at page
+ * START to be loaded in the background. Returns false if out of memory*/
+bool prefetch_request(void *start, size_t page_cnt)
+{
+	struct prefetch_req *req = malloc(sizeof *req);
+	if(req == NULL)
+		return false;
+	req->thread = thread_current();
+	req->start = start;
+	req->page_cnt = page_cnt;
+	req->cancelled = false;
+
+	lock_acquire(&queue_lock);
+	list_push_back(&queue, &req->elem);
+	cond_signal(&queue_cond, &queue_lock);
+	lock_release(&queue_lock);
+	return true;
+}
+
+/*Drops the requests of T, which is exiting, and waits until the prefetch
+ * thread no longer touches its pages*/
+void prefetch_cancel(struct thread *t)
+{
+	struct list_elem *e;
+
+	lock_acquire(&queue_lock);
+	for(e = list_begin(&queue); e != list_end(&queue);)
+	{
+		struct prefetch_req *req = list_entry(e, struct prefetch_req, elem);
+		e = list_next(e);
+		if(req->thread == t)
+		{
+			list_remove(&req->elem);
+			free(req);
+		}
+	}
+	while(busy != NULL && busy->thread == t)
+	{
+		busy->cancelled = true;
+		cond_wait(&done_cond, &queue_lock);
+	}
+	lock_release(&queue_lock);
+}
+
+/*Serves requests in order, forever*/
+static void prefetch_thread(void *aux UNUSED)
+{
+	for(;;)
+	{
+		lock_acquire(&queue_lock);
+		while(list_empty(&queue))
+			cond_wait(&queue_cond, &queue_lock);
+		busy = list_entry(list_pop_front(&queue), struct prefetch_req, elem);
+		lock_release(&queue_lock);
+
+		prefetch_pages(busy);
+
+		lock_acquire(&queue_lock);
+		free(busy);
+		busy = NULL;
+		cond_broadcast(&done_cond, &queue_lock);
+		lock_release(&queue_lock);
+	}
+}
+
+/*Loads the pages of REQ that are not resident and would have to be read
+ * from a file or from swap. Anonymous pages are left alone, since a fault
+ * on them costs no I/O*/
+static void prefetch_pages(struct prefetch_req *req)
+{
+	struct thread *t = req->thread;
+
+	for(size_t i = 0; i < req->page_cnt && !req->cancelled; ++i)
+	{
+		bool major;
+
+		lock_acquire(&t->vm_lock);
+		struct vm_entry *vme = vm_entry_find_in(t, req->start + i * PGSIZE);
+		if(vme != NULL && !vme->is_loaded && vme->type != PAGE_ANON)
+			handle_mm_fault(vme, false, &major);
+		lock_release(&t->vm_lock);
+	}
+}
@@ -0,0 +1,14 @@
+#ifndef VM_PREFETCH_H
+#define VM_PREFETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/thread.h"
+
+void prefetch_init(void);
+
+bool prefetch_request(void *, size_t);
+
+void prefetch_cancel(struct thread *);
+
+#endif /* VM_PREFETCH_H */
@@ -0,0 +1,404 @@
+#include "vm/swap.h"
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <lzf.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Swapped out pages are compressed and kept in memory first, in a
+   budget of pages taken from the kernel pool. Only when the budget is
+   used up are the least recently stored pages moved on to the swap
+   device, and a page that does not compress well goes there directly.
+   Every slot also owns a slot on the device, so a page kept in memory
+   can always be written out. Without a device, a page that does not fit
+   in the budget cannot be swapped out at all, and the evictor has to
+   choose another.
+
+   Compressed pages are packed at most two to a page of the budget, one
+   from each end, which is simple and keeps fragmentation low */
+
+/* Number of sectors in one swap slot */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A page that compresses to more than this goes to the swap device */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* Most pages moved to the swap device to make room for one page */
+#define ZSWAP_SPILL_MAX 4
+
+/* Page of the budget, holding up to two compressed pages */
+struct zpage{
+	struct list_elem elem; // Element in partial_pages while one half is free
+	uint16_t size[2]; // Bytes used by each half, 0 if free
+};
+
+/* Offset of the first half's data in a zpage */
+#define ZPAGE_HDR_SIZE sizeof(struct zpage)
+
+/* A page kept compressed in memory */
+struct zentry{
+	struct hash_elem elem; // Element in zentries
+	struct list_elem lru; // Element in zlru
+	size_t slot;
+	struct zpage *zpage;
+	int half; // 0 for the start of zpage, 1 for the end
+	bool spilling; // Being written to the device, see zswap_spill()
+	bool orphan; // Slot freed while spilling, freed by the spiller
+};
+
+/* The swap device, NULL if none was found */
+static struct block *swap_block;
+
+/* One bit per swap slot, true if the slot is in use */
+static struct bitmap *swap_map;
+
+/* Number of vm_entries that refer to each slot in use. Processes that
+   shared a copy-on-write page when it was swapped out share its slot */
+static unsigned *slot_refs;
+
+/* Protects swap_map, slot_refs and everything below */
+static struct lock swap_lock;
+
+/* Pages kept compressed, by slot, and from least to most recently stored */
+static struct hash zentries;
+static struct list zlru;
+
+/* zpages with a free half */
+static struct list partial_pages;
+
+/* zpages in use and the most that may be */
+static size_t zpage_cnt, zpage_max;
+
+/* zentries are allocated and freed on every swap out and in */
+static struct slab_cache zentry_cache;
+
+/* Scratch space for compression */
+static uint16_t htab[LZF_HTAB_SIZE];
+static uint8_t zbuf[ZSWAP_MAX_SIZE];
+
+/* Page being spilled, and whether a spill is in progress */
+static uint8_t spill_buf[PGSIZE];
+static bool spill_busy;
+
+/* Statistics */
+static uint64_t zswap_stores, zswap_loads, zswap_spills;
+static uint64_t disk_writes, disk_reads;
+
+static hash_hash_func zentry_hash;
+static hash_less_func zentry_less;
+static void write_slot(size_t, const void *);
+static void read_slot(size_t, void *);
+static bool zswap_store(size_t, size_t);
+static struct zentry *zswap_find(size_t);
+static void zswap_read(struct zentry *, void *);
+static void zswap_remove(struct zentry *);
+static bool zswap_spill(void);
+
+/*Sets up the slot bitmap for the swap device, if there is one, and a
+ * budget of ZSWAP_PAGES pages for compressed pages*/
+void swap_init(size_t zswap_pages)
+{
+	size_t slot_cnt;
+
+	lock_init(&swap_lock);
+	hash_init(&zentries, zentry_hash, zentry_less, NULL);
+	list_init(&zlru);
+	list_init(&partial_pages);
+	slab_cache_init(&zentry_cache, "zentry", sizeof(struct zentry), NULL);
+	zpage_max = zswap_pages;
+
+	// Without a device, slots exist only for pages kept in memory
+	swap_block = block_get_role(BLOCK_SWAP);
+	if(swap_block != NULL)
+		slot_cnt = block_size(swap_block) / SECTORS_PER_PAGE;
+	else
+		slot_cnt = 2 * zpage_max;
+	if(slot_cnt == 0)
+		return;
+
+	swap_map = bitmap_create(slot_cnt);
+	slot_refs = calloc(slot_cnt, sizeof *slot_refs);
+	if(swap_map == NULL || slot_refs == NULL)
+		PANIC("swap_init: cannot allocate swap bitmap");
+}
+
+/*Stores the page at KADDR in a free swap slot and returns the slot, with
+ * one reference. Returns SWAP_ERROR if every slot is in use, or if there is
+ * no swap device and the page does not fit in the compressed budget*/
+size_t swap_out(void *kaddr)
+{
+	if(swap_map == NULL)
+		return SWAP_ERROR;
+
+	lock_acquire(&swap_lock);
+	size_t slot = bitmap_scan_and_flip(swap_map, 0, 1, false);
+	if(slot == BITMAP_ERROR)
+	{
+		lock_release(&swap_lock);
+		return SWAP_ERROR;
+	}
+	slot_refs[slot] = 1;
+
+	for(int spills = 0; zpage_max > 0; ++spills)
+	{
+		// Compressed again after a spill, which lets others use zbuf
+		size_t size = lzf_compress(kaddr, PGSIZE, zbuf, sizeof zbuf, htab);
+		if(size == 0)
+			break;
+		if(zswap_store(slot, size))
+		{
+			lock_release(&swap_lock);
+			return slot;
+		}
+		if(spills == ZSWAP_SPILL_MAX || !zswap_spill())
+			break;
+	}
+	lock_release(&swap_lock);
+
+	if(swap_block == NULL)
+	{
+		swap_free(slot);
+		return SWAP_ERROR;
+	}
+	write_slot(slot, kaddr);
+	return slot;
+}
+
+/*Reads swap slot SLOT into the page at KADDR and releases a reference to
+ * the slot*/
+void swap_in(size_t slot, void *kaddr)
+{
+	ASSERT(swap_map != NULL);
+
+	lock_acquire(&swap_lock);
+	struct zentry *e = zswap_find(slot);
+	if(e != NULL)
+	{
+		zswap_read(e, kaddr);
+		zswap_loads++;
+	}
+	lock_release(&swap_lock);
+
+	if(e == NULL)
+		read_slot(slot, kaddr);
+	swap_free(slot);
+}
+
+/*Releases a reference to swap slot SLOT without reading it, and the slot
+ * itself with the last one*/
+void swap_free(size_t slot)
+{
+	ASSERT(swap_map != NULL);
+
+	lock_acquire(&swap_lock);
+	ASSERT(slot_refs[slot] > 0);
+	if(--slot_refs[slot] == 0)
+	{
+		struct zentry *e = zswap_find(slot);
+		if(e != NULL && e->spilling)
+			e->orphan = true;
+		else
+		{
+			if(e != NULL)
+				zswap_remove(e);
+			bitmap_reset(swap_map, slot);
+		}
+	}
+	lock_release(&swap_lock);
+}
+
+/*Adds a reference to swap slot SLOT, which is in use*/
+void swap_share(size_t slot)
+{
+	ASSERT(swap_map != NULL);
+
+	lock_acquire(&swap_lock);
+	ASSERT(slot_refs[slot] > 0);
+	slot_refs[slot]++;
+	lock_release(&swap_lock);
+}
+
+/*Prints swap statistics*/
+void swap_print_stats(void)
+{
+	printf("Swap: %zu of %zu compressed pages used, %"PRIu64" stores, "
+	       "%"PRIu64" loads, %"PRIu64" spills, %"PRIu64" disk writes, "
+	       "%"PRIu64" disk reads\n",
+	       zpage_cnt, zpage_max, zswap_stores, zswap_loads, zswap_spills,
+	       disk_writes, disk_reads);
+}
+
+/* Writes the page at KADDR to SLOT on the swap device */
+static void write_slot(size_t slot, const void *kaddr)
+{
+	ASSERT(swap_block != NULL);
+
+	for(int i = 0; i < SECTORS_PER_PAGE; ++i)
+		block_write(swap_block, slot * SECTORS_PER_PAGE + i,
+			    kaddr + i * BLOCK_SECTOR_SIZE);
+	disk_writes++;
+}
+
+/* Reads SLOT from the swap device into the page at KADDR */
+static void read_slot(size_t slot, void *kaddr)
+{
+	for(int i = 0; i < SECTORS_PER_PAGE; ++i)
+		block_read(swap_block, slot * SECTORS_PER_PAGE + i,
+			   kaddr + i * BLOCK_SECTOR_SIZE);
+	disk_reads++;
+}
+
+/* Returns the address of the data of E */
+static uint8_t *zentry_data(struct zentry *e)
+{
+	if(e->half == 0)
+		return (uint8_t *) e->zpage + ZPAGE_HDR_SIZE;
+	return (uint8_t *) e->zpage + PGSIZE - e->zpage->size[1];
+}
+
+/* Keeps the SIZE bytes in zbuf, the compressed contents of SLOT, in a
+   free half of a zpage, starting a new zpage if the budget allows.
+   Returns false if there is no room. Must be called with swap_lock held */
+static bool zswap_store(size_t slot, size_t size)
+{
+	struct zpage *zp = NULL;
+	struct list_elem *l;
+
+	for(l = list_begin(&partial_pages); l != list_end(&partial_pages); l = list_next(l))
+	{
+		struct zpage *p = list_entry(l, struct zpage, elem);
+		if(PGSIZE - ZPAGE_HDR_SIZE - p->size[0] - p->size[1] >= size)
+		{
+			zp = p;
+			break;
+		}
+	}
+	if(zp == NULL)
+	{
+		if(zpage_cnt >= zpage_max || (zp = palloc_get_page(0)) == NULL)
+			return false;
+		zp->size[0] = zp->size[1] = 0;
+		list_push_back(&partial_pages, &zp->elem);
+		zpage_cnt++;
+	}
+
+	struct zentry *e = slab_alloc(&zentry_cache);
+	if(e == NULL)
+	{
+		if(zp->size[0] == 0 && zp->size[1] == 0)
+		{
+			list_remove(&zp->elem);
+			palloc_free_page(zp);
+			zpage_cnt--;
+		}
+		return false;
+	}
+
+	e->slot = slot;
+	e->zpage = zp;
+	e->half = zp->size[0] == 0 ? 0 : 1;
+	e->spilling = e->orphan = false;
+	zp->size[e->half] = size;
+	if(zp->size[0] != 0 && zp->size[1] != 0)
+		list_remove(&zp->elem);
+	memcpy(zentry_data(e), zbuf, size);
+
+	hash_insert(&zentries, &e->elem);
+	list_push_back(&zlru, &e->lru);
+	zswap_stores++;
+	return true;
+}
+
+/* Returns the compressed page of SLOT, or NULL if it is not in memory.
+   Must be called with swap_lock held */
+static struct zentry *zswap_find(size_t slot)
+{
+	struct zentry key;
+	struct hash_elem *e;
+
+	key.slot = slot;
+	e = hash_find(&zentries, &key.elem);
+	return e != NULL ? hash_entry(e, struct zentry, elem) : NULL;
+}
+
+/* Decompresses E into the page at KADDR. Must be called with swap_lock
+   held */
+static void zswap_read(struct zentry *e, void *kaddr)
+{
+	size_t size = e->zpage->size[e->half];
+	if(lzf_decompress(zentry_data(e), size, kaddr, PGSIZE) != PGSIZE)
+		PANIC("swap: compressed page of slot %zu is corrupt", e->slot);
+}
+
+/* Frees E and its half of its zpage. Must be called with swap_lock held */
+static void zswap_remove(struct zentry *e)
+{
+	struct zpage *zp = e->zpage;
+	bool was_full = zp->size[0] != 0 && zp->size[1] != 0;
+
+	hash_delete(&zentries, &e->elem);
+	list_remove(&e->lru);
+	zp->size[e->half] = 0;
+	slab_free(e);
+
+	if(zp->size[0] == 0 && zp->size[1] == 0)
+	{
+		list_remove(&zp->elem);
+		palloc_free_page(zp);
+		zpage_cnt--;
+	}
+	else if(was_full)
+		list_push_back(&partial_pages, &zp->elem);
+}
+
+/* Moves the least recently stored compressed page to its slot on the
+   swap device. Returns false if there is none, no device, or another
+   spill is in progress. Must be called with swap_lock held, and releases
+   it while writing, so that faults on other slots need not wait for the
+   device. The entry stays in memory until then, and any read of the slot
+   decompresses it. Only one spill runs at a time, which keeps others from
+   choosing the same entry and from using spill_buf */
+static bool zswap_spill(void)
+{
+	if(list_empty(&zlru) || swap_block == NULL || spill_busy)
+		return false;
+
+	struct zentry *e = list_entry(list_front(&zlru), struct zentry, lru);
+	size_t slot = e->slot;
+	zswap_read(e, spill_buf);
+	e->spilling = true;
+	spill_busy = true;
+
+	lock_release(&swap_lock);
+	write_slot(slot, spill_buf);
+	lock_acquire(&swap_lock);
+
+	// Only the spiller removes a spilling entry, so E is still valid
+	bool orphan = e->orphan;
+	zswap_remove(e);
+	if(orphan)
+		bitmap_reset(swap_map, slot);
+	spill_busy = false;
+	zswap_spills++;
+	return true;
+}
+
+/* Hashes a zentry by its slot */
+static unsigned zentry_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+	return hash_int(hash_entry(e, struct zentry, elem)->slot);
+}
+
+/* Orders zentries by slot */
+static bool zentry_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
+{
+	return hash_entry(a, struct zentry, elem)->slot < hash_entry(b, struct zentry, elem)->slot;
+}
@@ -0,0 +1,21 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+/* Returned by swap_out() when the page cannot be swapped out */
+#define SWAP_ERROR ((size_t) -1)
+
+void swap_init(size_t);
+
+size_t swap_out(void *);
+
+void swap_in(size_t, void *);
+
+void swap_free(size_t);
+
+void swap_share(size_t);
+
+void swap_print_stats(void);
+
+#endif /* VM_SWAP_H */
@@ -0,0 +1,147 @@
+#include "vm/writeback.h"
+#include "vm/frame.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Dirty pages of mapped files are written back to their files by the
+   writeback thread in the background, so that the evictor nearly always
+   finds a clean victim and munmap has little left to write. The thread
+   writes every dirty file page each interval, and sooner when dirty
+   pages exceed the dirty ratio of the frame table or when the evictor
+   had to pass over one */
+
+/* Most pages written in one batch */
+#define WRITEBACK_BATCH 32
+
+/* Ticks between two checks of the dirty ratio */
+#define WRITEBACK_POLL (TIMER_FREQ / 10)
+
+/* -wbinterval, -wbratio: Ticks between two writebacks of every dirty
+   page, and percentage of frames that may be dirty before writeback
+   starts early */
+static int64_t interval;
+static unsigned dirty_ratio;
+
+/* Set by the evictor when it skipped a dirty page */
+static volatile bool urgent;
+
+/* Held by the writeback thread while it works on a batch */
+static struct lock writeback_lock;
+
+/* Batch being written, in file and offset order */
+static struct writeback_page batch[WRITEBACK_BATCH];
+
+/* Statistics */
+static uint64_t pages_written, batches_written;
+
+static thread_func writeback_thread;
+static bool should_write(int64_t);
+static void write_dirty_pages(void);
+static int batch_cmp(const void *, const void *);
+
+/*Starts the writeback thread, writing back every INTERVAL_MS milliseconds
+ * and whenever more than RATIO percent of the frames hold dirty file pages*/
+void writeback_init(unsigned interval_ms, unsigned ratio)
+{
+	interval = (int64_t) interval_ms * TIMER_FREQ / 1000;
+	if(interval < WRITEBACK_POLL)
+		interval = WRITEBACK_POLL;
+	dirty_ratio = ratio;
+	lock_init(&writeback_lock);
+	thread_create("writeback", PRI_DEFAULT, writeback_thread, NULL);
+}
+
+/*Asks for dirty pages to be written back at the next poll. Called by the
+ * evictor with frame_lock held, so it only sets a flag*/
+void writeback_kick(void)
+{
+	urgent = true;
+}
+
+/*Waits until the batch being written, if any, is on disk. munmap calls this
+ * after detaching its pages, so that reopening the file reads what was last
+ * written to the mapping*/
+void writeback_sync(void)
+{
+	lock_acquire(&writeback_lock);
+	lock_release(&writeback_lock);
+}
+
+/*Prints writeback statistics*/
+void writeback_print_stats(void)
+{
+	printf("Writeback: %"PRIu64" pages in %"PRIu64" batches\n",
+	       pages_written, batches_written);
+}
+
+/*Checks for dirty pages every WRITEBACK_POLL ticks, forever*/
+static void writeback_thread(void *aux UNUSED)
+{
+	int64_t next_writeback = timer_ticks() + interval;
+
+	for(;;)
+	{
+		timer_sleep(WRITEBACK_POLL);
+		if(!should_write(next_writeback))
+			continue;
+		urgent = false;
+		write_dirty_pages();
+		next_writeback = timer_ticks() + interval;
+	}
+}
+
+/* Returns true if dirty pages should be written back now, at the interval
+   NEXT_WRITEBACK or earlier */
+static bool should_write(int64_t next_writeback)
+{
+	size_t frame_cnt;
+	size_t dirty;
+
+	if(urgent || timer_ticks() >= next_writeback)
+		return true;
+	dirty = frame_count_dirty(&frame_cnt);
+	return dirty > 0 && dirty * 100 > dirty_ratio * frame_cnt;
+}
+
+/* Writes back dirty file pages a batch at a time until a batch comes up
+   short */
+static void write_dirty_pages(void)
+{
+	size_t cnt;
+
+	lock_acquire(&writeback_lock);
+	do
+	{
+		cnt = frame_writeback_begin(batch, WRITEBACK_BATCH);
+		qsort(batch, cnt, sizeof *batch, batch_cmp);
+		for(size_t i = 0; i < cnt; ++i)
+			file_write_at(batch[i].file, batch[i].frame->kaddr, batch[i].bytes, batch[i].ofs);
+		frame_writeback_end(batch, cnt);
+
+		pages_written += cnt;
+		if(cnt > 0)
+			batches_written++;
+	}
+	while(cnt == WRITEBACK_BATCH);
+	lock_release(&writeback_lock);
+}
+
+/* Orders pages by file, then by offset, so that each file is written
+   front to back */
+static int batch_cmp(const void *a_, const void *b_)
+{
+	const struct writeback_page *a = a_;
+	const struct writeback_page *b = b_;
+	struct inode *ia = file_get_inode(a->file);
+	struct inode *ib = file_get_inode(b->file);
+
+	if(ia != ib)
+		return ia < ib ? -1 : 1;
+	return a->ofs < b->ofs ? -1 : a->ofs > b->ofs;
+}
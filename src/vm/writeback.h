@@ -0,0 +1,14 @@
+#ifndef VM_WRITEBACK_H
+#define VM_WRITEBACK_H
+
+#include <stddef.h>
+
+void writeback_init(unsigned, unsigned);
+
+void writeback_kick(void);
+
+void writeback_sync(void);
+
+void writeback_print_stats(void);
+
+#endif /* VM_WRITEBACK_H */